@@ -0,0 +1,206 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BAREISS_SOLVER_HPP_GUARD
+#define BAREISS_SOLVER_HPP_GUARD
+
+#include <vector>
+#include "dense_matrix.hpp"
+#include "lu_decomposition.hpp"
+
+/* Exact solver for integer systems, by fraction-free (Bareiss) elimination.
+   Every entry stays an integer through the elimination: step k computes
+     a[i][j] = (a[k][k]*a[i][j] - a[i][k]*a[k][j]) / a[k-1][k-1]
+   where the division is always exact, and every entry is a minor of the
+   original matrix, so the numbers grow no faster than the determinant.
+   Nothing is normalized until the end, when the solution comes out as
+   integer numerators over one common denominator (Cramer's rule).
+   The template argument must behave like an integer (+-*, exact / and %).
+   Entries grow up to the size of the determinant, so use a wide type (long
+   long, or an arbitrary precision type) for anything but small systems. */
+
+/* The products in a step are up to twice as wide as the entries, before
+   the exact division brings them back. For built-in integers, they are
+   done in the next wider type, so only the entries themselves (the
+   minors of the matrix) have to fit in T. */
+template<class T> struct BareissWide { typedef T Type; };
+template<> struct BareissWide<int> { typedef long long Type; };
+#if defined(__SIZEOF_INT128__)
+template<> struct BareissWide<long> { typedef __int128 Type; };
+template<> struct BareissWide<long long> { typedef __int128 Type; };
+#endif
+
+template<class T> struct BareissSolver
+{
+  typedef typename BareissWide<T>::Type Wide;
+
+  static T Abs(const T& v)
+  {
+    return (v < T(0)) ? T(0) - v : v;
+  }
+
+  static T Gcd(T a, T b)
+  {
+    a = Abs(a);
+    b = Abs(b);
+    while(b != T(0)){
+      T c = a % b;
+      a = b;
+      b = c;
+    }
+    return a;
+  }
+
+  /* aug is n x (n+1), the matrix with the right-hand side as the last
+     column. On success, x[i] = num[i] / den with den > 0 and the fraction
+     in lowest terms as a whole. Returns false if the matrix is singular. */
+  static bool Solve(DenseMatrix<T>& aug, std::vector<T>& num, T& den)
+  {
+    int n = aug.Rows();
+    if(aug.Cols() != n + 1)
+      return false;
+
+    Wide prev(1);
+    for(int k=0; k<n; ++k){
+      /* exact arithmetic, so any nonzero pivot will do */
+      int p = k;
+      while(p < n && aug[p][k] == T(0))
+	++p;
+      if(p == n)
+	return false;
+      aug.SwapRows(k, p);
+
+      const T* pivotRow = aug[k];
+      Wide pivot = pivotRow[k];
+      for(int i=k+1; i<n; ++i){
+	T* row = aug[i];
+	Wide scale = row[k];
+	for(int j=k+1; j<=n; ++j)
+	  row[j] = static_cast<T>((pivot * row[j] - scale * pivotRow[j]) / prev);
+	row[k] = T(0);
+      }
+      prev = pivot;
+    }
+
+    /* aug[n-1][n-1] is the determinant of the row-permuted matrix, and the
+       Cramer numerators num[i] = den*x[i] are integers. Back substitution
+       on them divides exactly by the diagonal. */
+    den = aug[n-1][n-1];
+    num.resize(n);
+    for(int i=n-1; i>=0; --i){
+      const T* row = aug[i];
+      Wide sum = static_cast<Wide>(den) * row[n];
+      for(int j=i+1; j<n; ++j)
+	sum = sum - static_cast<Wide>(row[j]) * num[j];
+      num[i] = static_cast<T>(sum / row[i]);
+    }
+
+    T g = den;
+    for(int i=0; i<n; ++i)
+      g = Gcd(g, num[i]);
+    if(den < T(0))
+      g = T(0) - g;
+    den = den / g;
+    for(int i=0; i<n; ++i)
+      num[i] = num[i] / g;
+    return true;
+  }
+};
+
+/* Solves mat*x = vec for integer mat and vec, where the solution is
+   x[i] = num[i] / den. Neither mat nor vec is changed. */
+template<class T>
+bool bareiss_solver(const std::vector< std::vector<T> >& mat, const std::vector<T>& vec,
+		    std::vector<T>& num, T& den)
+{
+  int n = static_cast<int>(mat.size());
+  if(n == 0 || static_cast<int>(vec.size()) != n)
+    return false;
+  DenseMatrix<T> aug(n, n + 1);
+  for(int i=0; i<n; ++i){
+    if(static_cast<int>(mat[i].size()) != n)
+      return false;
+    for(int j=0; j<n; ++j)
+      aug[i][j] = mat[i][j];
+    aug[i][n] = vec[i];
+  }
+  return BareissSolver<T>::Solve(aug, num, den);
+}
+
+/* The solution of an integer system as fractions */
+template<class T>
+bool linear_solver(const std::vector< std::vector<T> >& mat, const std::vector<T>& vec,
+		   std::vector< Fraction<T> >& result)
+{
+  std::vector<T> num;
+  T den;
+  if(bareiss_solver(mat, vec, num, den) == false)
+    return false;
+  result.resize(num.size());
+  for(size_t i=0; i<num.size(); ++i)
+    result[i] = Fraction<T>(num[i], den);
+  return true;
+}
+
+/* Fraction systems are exact too, so they take the Bareiss path instead of
+   the LU factorization, which would normalize every intermediate fraction.
+   Each equation is multiplied by the lcm of its denominators, which makes
+   it an integer equation with the same solution. vec holds the answer if
+   the call succeeds, the matrix is left untouched. options is not used. */
+template<class T>
+bool linear_solver(std::vector< std::vector< Fraction<T> > >& mat, std::vector< Fraction<T> >& vec,
+		   const SolverOptions& options = SolverOptions())
+{
+  (void)options;
+  int n = static_cast<int>(mat.size());
+  if(n == 0 || static_cast<int>(vec.size()) != n)
+    return false;
+
+  DenseMatrix<T> aug(n, n + 1);
+  for(int i=0; i<n; ++i){
+    if(static_cast<int>(mat[i].size()) != n)
+      return false;
+    T scale = vec[i].Denominator();
+    for(int j=0; j<n; ++j){
+      T d = mat[i][j].Denominator();
+      scale = (scale / BareissSolver<T>::Gcd(scale, d)) * d;
+    }
+    for(int j=0; j<n; ++j)
+      aug[i][j] = mat[i][j].Numerator() * (scale / mat[i][j].Denominator());
+    aug[i][n] = vec[i].Numerator() * (scale / vec[i].Denominator());
+  }
+
+  std::vector<T> num;
+  T den;
+  if(BareissSolver<T>::Solve(aug, num, den) == false)
+    return false;
+  for(int i=0; i<n; ++i)
+    vec[i] = Fraction<T>(num[i], den);
+  return true;
+}
+
+#endif
@@ -0,0 +1,169 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BATCH_SOLVER_HPP_GUARD
+#define BATCH_SOLVER_HPP_GUARD
+
+#include <vector>
+#include <algorithm>
+#include "dense_matrix.hpp"
+#include "lu_decomposition.hpp"
+
+/* K independent NxN systems, solved together.
+   The storage is structure-of-arrays: coefficient (row, col) of all K
+   systems is one contiguous, aligned array, and so is every element of the
+   right-hand sides. Solve runs the same Gauss elimination (with partial
+   pivoting) on all systems in lockstep, so the inner loops run across
+   systems and vectorize, with no allocations per system. Pivoting is done
+   with per-system conditional swaps instead of branches. */
+template<class T, int N> class LinearSystemBatch
+{
+  /* rows 0..N*N-1 are the coefficients, rows N*N..N*N+N-1 the right-hand sides */
+  DenseMatrix<T> soa;
+
+  /* systems processed per pass, keeps the working set in the L1/L2 cache */
+  enum { CHUNK = 64 };
+
+public:
+  explicit LinearSystemBatch(int count = 0) : soa(N*N + N, count){}
+
+  int Count() const { return soa.Cols(); }
+  void Resize(int count) { soa.Resize(N*N + N, count); }
+
+  T& A(int system, int row, int col) { return soa[row*N + col][system]; }
+  const T& A(int system, int row, int col) const { return soa[row*N + col][system]; }
+  T& B(int system, int row) { return soa[N*N + row][system]; }
+  const T& B(int system, int row) const { return soa[N*N + row][system]; }
+
+  /* Element (row, col) or right-hand side row of every system, for filling
+     the batch with vector code */
+  T* ALanes(int row, int col) { return soa[row*N + col]; }
+  T* BLanes(int row) { return soa[N*N + row]; }
+
+  /* The solution of a system, valid after Solve if its mask entry is set */
+  const T& X(int system, int row) const { return B(system, row); }
+
+  void Set(int system, const std::vector< std::vector<T> >& mat, const std::vector<T>& vec)
+  {
+    for(int i=0; i<N; ++i){
+      for(int j=0; j<N; ++j)
+	A(system, i, j) = mat[i][j];
+      B(system, i) = vec[i];
+    }
+  }
+
+  void Get(int system, std::vector<T>& vec) const
+  {
+    vec.resize(N);
+    for(int i=0; i<N; ++i)
+      vec[i] = X(system, i);
+  }
+
+  /* Solves all systems. The coefficients are destroyed, and the right-hand
+     sides hold the solutions afterwards. mask[k] is set to 1 if system k was
+     solved and to 0 if it is singular. Returns the number of solved systems. */
+  int Solve(std::vector<unsigned char>& mask)
+  {
+    int count = Count();
+    mask.assign(count, 1);
+    for(int k0=0; k0<count; k0+=CHUNK)
+      SolveChunk(k0, std::min(count - k0, static_cast<int>(CHUNK)), &mask[k0]);
+    return static_cast<int>(std::count(mask.begin(), mask.end(), 1));
+  }
+
+private:
+  void SolveChunk(int k0, int lanes, unsigned char* ok)
+  {
+    T* a[N][N];
+    T* b[N];
+    for(int i=0; i<N; ++i){
+      for(int j=0; j<N; ++j)
+	a[i][j] = soa[i*N + j] + k0;
+      b[i] = soa[N*N + i] + k0;
+    }
+
+    /* per-system scratch, the innermost loops always run across systems */
+    T pivotInv[CHUNK];
+    T scale[CHUNK];
+    unsigned char swap[CHUNK];
+    for(int i=0; i<N; ++i){
+      /* partial pivoting: bubble the best pivot of column i up to row i */
+      for(int r=i+1; r<N; ++r){
+	for(int k=0; k<lanes; ++k)
+	  swap[k] = PivotTraits<T>::Better(a[r][i][k], a[i][i][k]);
+	for(int j=i; j<N; ++j)
+	  SwapLanes(a[i][j], a[r][j], swap, lanes);
+	SwapLanes(b[i], b[r], swap, lanes);
+      }
+
+      /* singular systems get a dummy pivot, so they stay finite */
+      for(int k=0; k<lanes; ++k){
+	bool zero = (a[i][i][k] == T(0));
+	ok[k] = zero ? 0 : ok[k];
+	pivotInv[k] = T(1) / (zero ? T(1) : a[i][i][k]);
+      }
+
+      for(int r=i+1; r<N; ++r){
+	for(int k=0; k<lanes; ++k)
+	  scale[k] = a[r][i][k] * pivotInv[k];
+	for(int j=i+1; j<N; ++j){
+	  T* dst = a[r][j];
+	  const T* src = a[i][j];
+	  for(int k=0; k<lanes; ++k)
+	    dst[k] -= scale[k] * src[k];
+	}
+	for(int k=0; k<lanes; ++k)
+	  b[r][k] -= scale[k] * b[i][k];
+      }
+    }
+
+    /* back substitution, the solution overwrites b */
+    for(int i=N-1; i>=0; --i){
+      T* x = b[i];
+      for(int j=i+1; j<N; ++j){
+	const T* aij = a[i][j];
+	const T* xj = b[j];
+	for(int k=0; k<lanes; ++k)
+	  x[k] -= aij[k] * xj[k];
+      }
+      const T* pivot = a[i][i];
+      for(int k=0; k<lanes; ++k)
+	x[k] /= (pivot[k] == T(0) ? T(1) : pivot[k]);
+    }
+  }
+
+  static void SwapLanes(T* x, T* y, const unsigned char* swap, int lanes)
+  {
+    for(int k=0; k<lanes; ++k){
+      T u = x[k], v = y[k];
+      x[k] = swap[k] ? v : u;
+      y[k] = swap[k] ? u : v;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DENSE_MATRIX_HPP_GUARD
+#define DENSE_MATRIX_HPP_GUARD
+
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+/* Alignment of the matrix storage and of every row. 64 bytes is both a
+   cache line and the width of an AVX-512 register. */
+const size_t DENSE_MATRIX_ALIGNMENT = 64;
+
+inline void* AlignedAlloc(size_t bytes, size_t alignment)
+{
+  if(bytes == 0)
+    bytes = alignment;
+#if defined(_MSC_VER)
+  void* p = _aligned_malloc(bytes, alignment);
+#else
+  void* p = 0;
+  if(posix_memalign(&p, alignment, bytes) != 0)
+    p = 0;
+#endif
+  if(p == 0)
+    throw std::bad_alloc();
+  return p;
+}
+
+inline void AlignedFree(void* p)
+{
+#if defined(_MSC_VER)
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+/* Row-major dense matrix in a single aligned allocation.
+   Each row starts on an aligned boundary, as the row stride is padded to a
+   multiple of DENSE_MATRIX_ALIGNMENT bytes when the element size allows it.
+   Rows are reached through a table of row pointers, so SwapRows only swaps
+   two pointers. Because of that, operator[] returns a row pointer and
+   mat[i][j] works just like it does on a std::vector of rows. */
+template<class T> class DenseMatrix
+{
+  T* data;
+  std::vector<T*> rows;
+  int nrows, ncols, stride;
+public:
+  DenseMatrix() : data(0), nrows(0), ncols(0), stride(0){}
+  DenseMatrix(int r, int c) : data(0), nrows(0), ncols(0), stride(0)
+  {
+    Resize(r, c);
+  }
+  explicit DenseMatrix(const std::vector< std::vector<T> >& mat) : data(0), nrows(0), ncols(0), stride(0)
+  {
+    Assign(mat);
+  }
+  DenseMatrix(const DenseMatrix<T>& right) : data(0), nrows(0), ncols(0), stride(0)
+  {
+    Resize(right.nrows, right.ncols);
+    for(int i=0; i<nrows; ++i)
+      std::copy(right.rows[i], right.rows[i] + ncols, rows[i]);
+  }
+  ~DenseMatrix()
+  {
+    Release();
+  }
+
+  DenseMatrix<T>& operator=(const DenseMatrix<T>& right)
+  {
+    if(this != &right){
+      DenseMatrix<T> tmp(right);
+      Swap(tmp);
+    }
+    return *this;
+  }
+
+  int Rows() const { return nrows; }
+  int Cols() const { return ncols; }
+  int Stride() const { return stride; }
+
+  T* operator[](int row) { return rows[row]; }
+  const T* operator[](int row) const { return rows[row]; }
+
+  T& operator()(int row, int col) { return rows[row][col]; }
+  const T& operator()(int row, int col) const { return rows[row][col]; }
+
+  /* Swaps two rows by swapping their row pointers */
+  void SwapRows(int row1, int row2)
+  {
+    std::swap(rows[row1], rows[row2]);
+  }
+
+  void Swap(DenseMatrix<T>& right)
+  {
+    std::swap(data, right.data);
+    rows.swap(right.rows);
+    std::swap(nrows, right.nrows);
+    std::swap(ncols, right.ncols);
+    std::swap(stride, right.stride);
+  }
+
+  /* Reallocates the matrix. The contents are value-initialized. */
+  void Resize(int r, int c)
+  {
+    Release();
+    int padded = c;
+    if(sizeof(T) <= DENSE_MATRIX_ALIGNMENT && DENSE_MATRIX_ALIGNMENT % sizeof(T) == 0){
+      int width = static_cast<int>(DENSE_MATRIX_ALIGNMENT / sizeof(T));
+      padded = (c + width - 1) / width * width;
+    }
+    size_t count = static_cast<size_t>(r) * padded;
+    T* p = static_cast<T*>(AlignedAlloc(count * sizeof(T), DENSE_MATRIX_ALIGNMENT));
+    size_t constructed = 0;
+    try {
+      for(; constructed<count; ++constructed)
+	new (p + constructed) T();
+    } catch(...) {
+      Destroy(p, constructed);
+      throw;
+    }
+    data = p;
+    nrows = r;
+    ncols = c;
+    stride = padded;
+    rows.resize(r);
+    for(int i=0; i<r; ++i)
+      rows[i] = data + static_cast<size_t>(i) * stride;
+  }
+
+  void Assign(const std::vector< std::vector<T> >& mat)
+  {
+    int r = static_cast<int>(mat.size());
+    int c = r ? static_cast<int>(mat[0].size()) : 0;
+    Resize(r, c);
+    for(int i=0; i<r; ++i){
+      int len = std::min(c, static_cast<int>(mat[i].size()));
+      std::copy(mat[i].begin(), mat[i].begin() + len, rows[i]);
+    }
+  }
+
+  /* Copies the matrix back into a vector of rows, in the current row order */
+  void ToVector(std::vector< std::vector<T> >& mat) const
+  {
+    mat.resize(nrows);
+    for(int i=0; i<nrows; ++i)
+      mat[i].assign(rows[i], rows[i] + ncols);
+  }
+
+private:
+  void Release()
+  {
+    if(data)
+      Destroy(data, static_cast<size_t>(nrows) * stride);
+    data = 0;
+    rows.clear();
+    nrows = ncols = stride = 0;
+  }
+
+  static void Destroy(T* p, size_t count)
+  {
+    for(size_t i=0; i<count; ++i)
+      p[i].~T();
+    AlignedFree(p);
+  }
+};
+
+#endif
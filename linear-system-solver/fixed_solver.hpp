@@ -0,0 +1,211 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FIXED_SOLVER_HPP_GUARD
+#define FIXED_SOLVER_HPP_GUARD
+
+#include <array>
+#include <cstddef>
+#include "lu_decomposition.hpp"
+#include "../vector/vector2.h"
+#include "../vector/vector3.h"
+#include "../vector/vector4.h"
+#include "../vector/matrix4.h"
+
+/* Solvers for systems whose size N is known at compile time.
+   Nothing is allocated, and every loop has a constant trip count, so the
+   compiler unrolls them completely. N <= 3 uses Cramer's rule, bigger
+   systems use Gauss elimination with partial pivoting, unrolled one column
+   at a time through FixedElimination. With C++17 (constexpr std::array
+   access), the solvers can be evaluated at compile time. */
+
+template<class T, size_t N> using FixedMatrix = std::array<std::array<T, N>, N>;
+template<class T, size_t N> using FixedVector = std::array<T, N>;
+
+/* Eliminates column K and below, leaving the matrix upper triangular */
+template<class T, size_t N, size_t K = 0> struct FixedElimination
+{
+  static constexpr bool Run(FixedMatrix<T, N>& a, FixedVector<T, N>& b)
+  {
+    size_t p = K;
+    for(size_t i=K+1; i<N; ++i){
+      if(PivotTraits<T>::Better(a[i][K], a[p][K]))
+	p = i;
+    }
+    if(a[p][K] == T(0))
+      return false;
+
+    if(p != K){
+      for(size_t j=K; j<N; ++j){
+	T tmp = a[K][j];
+	a[K][j] = a[p][j];
+	a[p][j] = tmp;
+      }
+      T tmp = b[K];
+      b[K] = b[p];
+      b[p] = tmp;
+    }
+
+    for(size_t i=K+1; i<N; ++i){
+      T scale = a[i][K] / a[K][K];
+      for(size_t j=K+1; j<N; ++j)
+	a[i][j] -= a[K][j] * scale;
+      b[i] -= b[K] * scale;
+    }
+    return FixedElimination<T, N, K+1>::Run(a, b);
+  }
+};
+
+template<class T, size_t N> struct FixedElimination<T, N, N>
+{
+  static constexpr bool Run(FixedMatrix<T, N>&, FixedVector<T, N>&)
+  {
+    return true;
+  }
+};
+
+template<class T, size_t N> struct FixedSolver
+{
+  static constexpr bool Solve(FixedMatrix<T, N>& a, FixedVector<T, N>& b)
+  {
+    if(FixedElimination<T, N>::Run(a, b) == false)
+      return false;
+    for(size_t n=N; n>0; --n){
+      size_t i = n-1;
+      T sum = b[i];
+      for(size_t j=i+1; j<N; ++j)
+	sum -= a[i][j] * b[j];
+      b[i] = sum / a[i][i];
+    }
+    return true;
+  }
+};
+
+template<class T> struct FixedSolver<T, 1>
+{
+  static constexpr bool Solve(FixedMatrix<T, 1>& a, FixedVector<T, 1>& b)
+  {
+    if(a[0][0] == T(0))
+      return false;
+    b[0] = b[0] / a[0][0];
+    return true;
+  }
+};
+
+/* Cramer's rule */
+template<class T> struct FixedSolver<T, 2>
+{
+  static constexpr bool Solve(FixedMatrix<T, 2>& a, FixedVector<T, 2>& b)
+  {
+    T det = a[0][0]*a[1][1] - a[0][1]*a[1][0];
+    if(det == T(0))
+      return false;
+    T x = b[0]*a[1][1] - a[0][1]*b[1];
+    T y = a[0][0]*b[1] - b[0]*a[1][0];
+    b[0] = x / det;
+    b[1] = y / det;
+    return true;
+  }
+};
+
+/* Cramer's rule, with the cofactors of the first column shared between
+   the determinant and the numerators */
+template<class T> struct FixedSolver<T, 3>
+{
+  static constexpr bool Solve(FixedMatrix<T, 3>& a, FixedVector<T, 3>& b)
+  {
+    T c0 = a[1][1]*a[2][2] - a[1][2]*a[2][1];
+    T c1 = a[1][2]*a[2][0] - a[1][0]*a[2][2];
+    T c2 = a[1][0]*a[2][1] - a[1][1]*a[2][0];
+    T det = a[0][0]*c0 + a[0][1]*c1 + a[0][2]*c2;
+    if(det == T(0))
+      return false;
+
+    /* minors of rows 1 and 2 with one column replaced by b[1], b[2] */
+    T m0 = b[1]*a[2][2] - a[1][2]*b[2];
+    T m1 = a[1][1]*b[2] - b[1]*a[2][1];
+    T m2 = a[1][0]*b[2] - b[1]*a[2][0];
+    T x = b[0]*c0 - a[0][1]*m0 - a[0][2]*m1;
+    T y = a[0][0]*m0 + b[0]*c1 + a[0][2]*m2;
+    T z = a[0][0]*m1 - a[0][1]*m2 + b[0]*c2;
+    b[0] = x / det;
+    b[1] = y / det;
+    b[2] = z / det;
+    return true;
+  }
+};
+
+/* Solves mat*x = vec. vec holds the answer if the call succeeds, mat is
+   destroyed. */
+template<class T, size_t N>
+constexpr bool linear_solver(FixedMatrix<T, N>& mat, FixedVector<T, N>& vec)
+{
+  return FixedSolver<T, N>::Solve(mat, vec);
+}
+
+/* The rows of the system given as vectors, the right-hand side in vec */
+template<class T>
+bool linear_solver(const Vector2<T>& row0, const Vector2<T>& row1, Vector2<T>& vec)
+{
+  FixedMatrix<T, 2> a = {{ {{row0.x, row0.y}}, {{row1.x, row1.y}} }};
+  FixedVector<T, 2> b = {{ vec.x, vec.y }};
+  if(FixedSolver<T, 2>::Solve(a, b) == false)
+    return false;
+  vec = Vector2<T>(b[0], b[1]);
+  return true;
+}
+
+template<class T>
+bool linear_solver(const Vector3<T>& row0, const Vector3<T>& row1, const Vector3<T>& row2, Vector3<T>& vec)
+{
+  FixedMatrix<T, 3> a = {{ {{row0.x, row0.y, row0.z}},
+			   {{row1.x, row1.y, row1.z}},
+			   {{row2.x, row2.y, row2.z}} }};
+  FixedVector<T, 3> b = {{ vec.x, vec.y, vec.z }};
+  if(FixedSolver<T, 3>::Solve(a, b) == false)
+    return false;
+  vec = Vector3<T>(b[0], b[1], b[2]);
+  return true;
+}
+
+/* Matrix4 is row-major, the same layout operator*(Matrix4, Vector4) uses */
+template<class T>
+bool linear_solver(const Matrix4<T>& mat, Vector4<T>& vec)
+{
+  FixedMatrix<T, 4> a = {};
+  for(size_t i=0; i<4; ++i){
+    for(size_t j=0; j<4; ++j)
+      a[i][j] = mat[i*4 + j];
+  }
+  FixedVector<T, 4> b = {{ vec.x, vec.y, vec.z, vec.w }};
+  if(FixedSolver<T, 4>::Solve(a, b) == false)
+    return false;
+  vec = Vector4<T>(b[0], b[1], b[2], b[3]);
+  return true;
+}
+
+#endif
@@ -0,0 +1,440 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ITERATIVE_SOLVER_HPP_GUARD
+#define ITERATIVE_SOLVER_HPP_GUARD
+
+#include <vector>
+#include <cmath>
+#include "dense_matrix.hpp"
+#include "sparse_matrix.hpp"
+#include "row_kernels.hpp"
+
+/* Iterative solvers for large systems: Conjugate Gradient for symmetric
+   positive definite matrices, BiCGSTAB for general ones.
+   The matrix is only used through a matrix-vector product, an operator
+   op(x, y) that sets y = A*x, so it can be a SparseMatrix, a DenseMatrix
+   (see SparseOperator and DenseOperator) or something that is never stored
+   at all. A preconditioner is another operator, precond(r, z), that sets z
+   to an approximation of A^-1 * r.
+   x holds the initial guess on entry and the solution on return. Passing
+   the solution of a similar system (the previous frame of a simulation)
+   as the guess usually saves most of the iterations; pass zeros, or an
+   empty vector, to start from scratch. */
+
+struct IterativeOptions
+{
+  double tolerance;   /* stop when |b - A*x| <= tolerance * |b| */
+  int maxIterations;  /* 0 means the size of the system */
+
+  IterativeOptions() : tolerance(1e-8), maxIterations(0){}
+  IterativeOptions(double tol, int iterations) : tolerance(tol), maxIterations(iterations){}
+};
+
+struct IterativeResult
+{
+  bool converged;
+  int iterations;
+  double residual;    /* |b - A*x| / |b| when the solver stopped */
+
+  IterativeResult() : converged(false), iterations(0), residual(0.0){}
+};
+
+/* y = A*x for a SparseMatrix */
+template<class T> class SparseOperator
+{
+  const SparseMatrix<T>& mat;
+public:
+  explicit SparseOperator(const SparseMatrix<T>& m) : mat(m){}
+  int Size() const { return mat.Rows(); }
+  void operator()(const std::vector<T>& x, std::vector<T>& y) const
+  {
+    mat.Multiply(x, y);
+  }
+};
+
+/* y = A*x for a DenseMatrix */
+template<class T> class DenseOperator
+{
+  const DenseMatrix<T>& mat;
+public:
+  explicit DenseOperator(const DenseMatrix<T>& m) : mat(m){}
+  int Size() const { return mat.Rows(); }
+  void operator()(const std::vector<T>& x, std::vector<T>& y) const
+  {
+    y.resize(mat.Rows());
+    for(int i=0; i<mat.Rows(); ++i)
+      y[i] = RowDot(mat[i], &x[0], mat.Cols());
+  }
+};
+
+/* No preconditioning, z = r */
+template<class T> struct IdentityPreconditioner
+{
+  void operator()(const std::vector<T>& r, std::vector<T>& z) const
+  {
+    z = r;
+  }
+};
+
+/* Jacobi preconditioner, z = D^-1 * r with D the diagonal of A.
+   Cheap, and enough for diagonally dominant matrices. */
+template<class T> class JacobiPreconditioner
+{
+  std::vector<T> inv;
+public:
+  JacobiPreconditioner(){}
+  explicit JacobiPreconditioner(const SparseMatrix<T>& mat)
+  {
+    std::vector<T> diag(mat.Cols(), T(0));
+    for(int j=0; j<mat.Cols(); ++j){
+      for(int p=mat.ColumnBegin(j); p<mat.ColumnEnd(j); ++p){
+	if(mat.RowIndex(p) == j)
+	  diag[j] = mat.Value(p);
+      }
+    }
+    SetDiagonal(diag);
+  }
+  explicit JacobiPreconditioner(const DenseMatrix<T>& mat)
+  {
+    std::vector<T> diag(mat.Rows());
+    for(int i=0; i<mat.Rows(); ++i)
+      diag[i] = mat(i, i);
+    SetDiagonal(diag);
+  }
+
+  /* zeros on the diagonal are left alone */
+  void SetDiagonal(const std::vector<T>& diag)
+  {
+    inv.resize(diag.size());
+    for(size_t i=0; i<diag.size(); ++i)
+      inv[i] = (diag[i] == T(0)) ? T(1) : T(1) / diag[i];
+  }
+
+  void operator()(const std::vector<T>& r, std::vector<T>& z) const
+  {
+    z.resize(r.size());
+    for(size_t i=0; i<r.size(); ++i)
+      z[i] = inv[i] * r[i];
+  }
+};
+
+/* Incomplete Cholesky preconditioner, IC(0): A ~ L*L' where L has the
+   nonzero pattern of the lower triangle of A, and all other fill-in is
+   dropped. Only the lower triangle of A is read. If the factorization
+   breaks down (a pivot <= 0, which can happen even for positive definite
+   matrices), it is restarted on A + shift*diag(A) with a growing shift. */
+template<class T> class IncompleteCholesky
+{
+  int n;
+  std::vector<int> lp, li;   /* CSC, diagonal first in every column */
+  std::vector<T> lx;
+  T shift;
+public:
+  IncompleteCholesky() : n(0), shift(T(0)){}
+  explicit IncompleteCholesky(const SparseMatrix<T>& mat) : n(0), shift(T(0))
+  {
+    Factor(mat);
+  }
+
+  /* The diagonal shift that was needed, zero if none */
+  T Shift() const { return shift; }
+  int NonZeros() const { return lp.empty() ? 0 : lp[n]; }
+
+  /* Returns false if the matrix is not square or has no positive diagonal */
+  bool Factor(const SparseMatrix<T>& mat)
+  {
+    n = 0;
+    if(mat.Rows() != mat.Cols())
+      return false;
+    int size = mat.Cols();
+
+    /* the lower triangle, diagonal first */
+    lp.assign(size + 1, 0);
+    li.clear();
+    std::vector<T> ax;
+    for(int j=0; j<size; ++j){
+      lp[j] = static_cast<int>(li.size());
+      li.push_back(j);
+      ax.push_back(T(0));
+      for(int p=mat.ColumnBegin(j); p<mat.ColumnEnd(j); ++p){
+	int i = mat.RowIndex(p);
+	if(i == j)
+	  ax[lp[j]] = mat.Value(p);
+	else if(i > j){
+	  li.push_back(i);
+	  ax.push_back(mat.Value(p));
+	}
+      }
+      if(!(T(0) < ax[lp[j]]))
+	return false;
+    }
+    lp[size] = static_cast<int>(li.size());
+    n = size;
+
+    shift = T(0);
+    for(int attempt=0; attempt<16; ++attempt){
+      lx = ax;
+      if(shift != T(0)){
+	for(int j=0; j<n; ++j)
+	  lx[lp[j]] += shift * ax[lp[j]];
+      }
+      if(FactorShifted())
+	return true;
+      shift = (shift == T(0)) ? T(1e-3) : shift * T(4);
+    }
+    n = 0;
+    return false;
+  }
+
+  /* z = (L*L')^-1 * r */
+  void operator()(const std::vector<T>& r, std::vector<T>& z) const
+  {
+    z = r;
+    for(int j=0; j<n; ++j){
+      T zj = z[j] / lx[lp[j]];
+      z[j] = zj;
+      for(int p=lp[j]+1; p<lp[j+1]; ++p)
+	z[li[p]] -= lx[p] * zj;
+    }
+    for(int j=n-1; j>=0; --j){
+      T sum = z[j];
+      for(int p=lp[j]+1; p<lp[j+1]; ++p)
+	sum -= lx[p] * z[li[p]];
+      z[j] = sum / lx[lp[j]];
+    }
+  }
+
+private:
+  /* Right-looking, column by column. The update of column j by column k
+     only touches entries already in column j, found through pos. */
+  bool FactorShifted()
+  {
+    std::vector<int> pos(n, -1);
+    for(int k=0; k<n; ++k){
+      T d = lx[lp[k]];
+      if(!(T(0) < d))
+	return false;
+      d = std::sqrt(d);
+      lx[lp[k]] = d;
+      for(int p=lp[k]+1; p<lp[k+1]; ++p)
+	lx[p] /= d;
+
+      for(int p=lp[k]+1; p<lp[k+1]; ++p){
+	int j = li[p];
+	T ljk = lx[p];
+	for(int s=lp[j]; s<lp[j+1]; ++s)
+	  pos[li[s]] = s;
+	/* rows i >= j of column k, they come after p in column k */
+	for(int s=p; s<lp[k+1]; ++s){
+	  int t = pos[li[s]];
+	  if(t >= 0)
+	    lx[t] -= lx[s] * ljk;
+	}
+	for(int s=lp[j]; s<lp[j+1]; ++s)
+	  pos[li[s]] = -1;
+      }
+    }
+    return true;
+  }
+};
+
+/* Vector helpers for the solvers below */
+template<class T> struct IterativeKernels
+{
+  static T Dot(const std::vector<T>& a, const std::vector<T>& b)
+  {
+    return a.empty() ? T(0) : RowDot(&a[0], &b[0], static_cast<int>(a.size()));
+  }
+  static double Norm(const std::vector<T>& a)
+  {
+    return std::sqrt(static_cast<double>(Dot(a, a)));
+  }
+  /* dst += scale * src, RowAxpy subtracts */
+  static void Axpy(std::vector<T>& dst, const std::vector<T>& src, T scale)
+  {
+    if(!dst.empty())
+      RowAxpy(&dst[0], &src[0], T(0) - scale, static_cast<int>(dst.size()));
+  }
+  /* r = b - A*x, returns |r| */
+  template<class Op>
+  static double Residual(const Op& op, const std::vector<T>& b, const std::vector<T>& x,
+			 std::vector<T>& ax, std::vector<T>& r)
+  {
+    op(x, ax);
+    r.resize(b.size());
+    for(size_t i=0; i<b.size(); ++i)
+      r[i] = b[i] - ax[i];
+    return Norm(r);
+  }
+};
+
+/* Preconditioned Conjugate Gradient. A must be symmetric positive
+   definite, and so must the preconditioner. */
+template<class T, class Op, class Precond>
+IterativeResult ConjugateGradient(const Op& op, const std::vector<T>& b, std::vector<T>& x,
+				  const Precond& precond, const IterativeOptions& options = IterativeOptions())
+{
+  typedef IterativeKernels<T> K;
+  IterativeResult result;
+  size_t n = b.size();
+  if(x.size() != n)
+    x.assign(n, T(0));
+  int maxIterations = (options.maxIterations > 0) ? options.maxIterations : static_cast<int>(n);
+
+  double bnorm = K::Norm(b);
+  if(bnorm == 0.0){
+    x.assign(n, T(0));
+    result.converged = true;
+    return result;
+  }
+
+  std::vector<T> r, z, p, ap;
+  double rnorm = K::Residual(op, b, x, ap, r);
+  result.residual = rnorm / bnorm;
+  if(result.residual <= options.tolerance){
+    result.converged = true;
+    return result;
+  }
+
+  precond(r, z);
+  p = z;
+  T rz = K::Dot(r, z);
+  for(int it=1; it<=maxIterations; ++it){
+    op(p, ap);
+    T pap = K::Dot(p, ap);
+    if(pap == T(0))
+      break;
+    T alpha = rz / pap;
+    K::Axpy(x, p, alpha);
+    K::Axpy(r, ap, T(0) - alpha);
+    result.iterations = it;
+    result.residual = K::Norm(r) / bnorm;
+    if(result.residual <= options.tolerance){
+      result.converged = true;
+      break;
+    }
+
+    precond(r, z);
+    T rzNew = K::Dot(r, z);
+    T beta = rzNew / rz;
+    rz = rzNew;
+    for(size_t i=0; i<n; ++i)
+      p[i] = z[i] + beta * p[i];
+  }
+  return result;
+}
+
+/* Preconditioned BiCGSTAB, for matrices that are not symmetric. Each
+   iteration costs two products with A and two preconditioner calls. */
+template<class T, class Op, class Precond>
+IterativeResult BiCGStab(const Op& op, const std::vector<T>& b, std::vector<T>& x,
+			 const Precond& precond, const IterativeOptions& options = IterativeOptions())
+{
+  typedef IterativeKernels<T> K;
+  IterativeResult result;
+  size_t n = b.size();
+  if(x.size() != n)
+    x.assign(n, T(0));
+  int maxIterations = (options.maxIterations > 0) ? options.maxIterations : static_cast<int>(n);
+
+  double bnorm = K::Norm(b);
+  if(bnorm == 0.0){
+    x.assign(n, T(0));
+    result.converged = true;
+    return result;
+  }
+
+  std::vector<T> r, r0, p, v, s, t, y, z;
+  double rnorm = K::Residual(op, b, x, v, r);
+  result.residual = rnorm / bnorm;
+  if(result.residual <= options.tolerance){
+    result.converged = true;
+    return result;
+  }
+
+  r0 = r;
+  p.assign(n, T(0));
+  v.assign(n, T(0));
+  T rho(1), alpha(1), omega(1);
+  for(int it=1; it<=maxIterations; ++it){
+    T rhoNew = K::Dot(r0, r);
+    if(rhoNew == T(0) || omega == T(0))
+      break;
+    T beta = (rhoNew / rho) * (alpha / omega);
+    rho = rhoNew;
+    for(size_t i=0; i<n; ++i)
+      p[i] = r[i] + beta * (p[i] - omega * v[i]);
+
+    precond(p, y);
+    op(y, v);
+    T r0v = K::Dot(r0, v);
+    if(r0v == T(0))
+      break;
+    alpha = rho / r0v;
+    s = r;
+    K::Axpy(s, v, T(0) - alpha);
+    K::Axpy(x, y, alpha);
+    result.iterations = it;
+    result.residual = K::Norm(s) / bnorm;
+    if(result.residual <= options.tolerance){
+      result.converged = true;
+      break;
+    }
+
+    precond(s, z);
+    op(z, t);
+    T tt = K::Dot(t, t);
+    omega = (tt == T(0)) ? T(0) : K::Dot(t, s) / tt;
+    K::Axpy(x, z, omega);
+    r = s;
+    K::Axpy(r, t, T(0) - omega);
+    result.residual = K::Norm(r) / bnorm;
+    if(result.residual <= options.tolerance){
+      result.converged = true;
+      break;
+    }
+  }
+  return result;
+}
+
+/* Without a preconditioner */
+template<class T, class Op>
+IterativeResult ConjugateGradient(const Op& op, const std::vector<T>& b, std::vector<T>& x,
+				  const IterativeOptions& options = IterativeOptions())
+{
+  return ConjugateGradient(op, b, x, IdentityPreconditioner<T>(), options);
+}
+
+template<class T, class Op>
+IterativeResult BiCGStab(const Op& op, const std::vector<T>& b, std::vector<T>& x,
+			 const IterativeOptions& options = IterativeOptions())
+{
+  return BiCGStab(op, b, x, IdentityPreconditioner<T>(), options);
+}
+
+#endif
@@ -30,6 +30,26 @@
 
 #include <vector>
 #include <utility>
+#include "dense_matrix.hpp"
+#include "row_kernels.hpp"
+#include "lu_decomposition.hpp"
+#include "bareiss_solver.hpp"
+
+/* The row operations below work on a DenseMatrix, where a row swap is a
+   pointer swap. The std::vector overloads are kept for existing code. */
+
+template<class T>
+bool SwapRows(int row, DenseMatrix<T>& mat)
+{
+  /* find the first row with mat[i][j] nonzero */
+  for(int i2=row+1; i2<mat.Rows(); ++i2){
+    if(mat[i2][row] != T(0)){
+      mat.SwapRows(row, i2);
+      return true;
+    }
+  }
+  return false;
+}
 
 template<class T>
 bool SwapRows(int row, std::vector< std::vector<T> >& mat)
@@ -47,6 +67,17 @@ bool SwapRows(int row, std::vector< std::vector<T> >& mat)
   return true;
 }
 
+template<class T>
+void ScaleRowWithPivot(int row, DenseMatrix<T>& mat)
+{
+  T scale = mat[row][row];
+  if(scale == T(0))
+    return;
+  T* r = mat[row];
+  for(int j=0; j<mat.Cols(); ++j)
+    r[j] /= scale;
+}
+
 template<class T>
 void ScaleRowWithPivot(int row, std::vector< std::vector<T> >& mat)
 {
@@ -57,6 +88,21 @@ void ScaleRowWithPivot(int row, std::vector< std::vector<T> >& mat)
     mat[row][j] /= scale;
 }
 
+template<class T>
+void BackSubstitution(DenseMatrix<T>& mat)
+{
+  /* i is the column, j is the row*/
+
+  for(int i=mat.Rows()-1; i > 0; --i){
+    const T* ri = mat[i];
+    for(int j=i-1; j >= 0; --j){
+      T* rj = mat[j];
+      T scale = rj[i];
+      RowAxpy(rj, ri, scale, mat.Cols());
+    }
+  }
+}
+
 template<class T>
 void BackSubstitution(std::vector< std::vector<T> >& mat)
 {
@@ -65,67 +111,46 @@ void BackSubstitution(std::vector< std::vector<T> >& mat)
   for(int i=mat.size()-1; i > 0; --i){
     for(int j=i-1; j >= 0; --j){
       T scale = mat[j][i];
-      for(int k=0; k<mat[j].size(); ++k){
-	mat[j][k] -= mat[i][k] * scale;
-      }
+      RowAxpy(&mat[j][0], &mat[i][0], scale, static_cast<int>(mat[j].size()));
     }
   }
 }
 
+/* Solves mat*x = vec. vec holds the answer if the call succeeds.
+   The matrix is consumed: it is factored in place with partial pivoting,
+   and holds the LU factors (rows in pivot order) afterwards. To solve the
+   same matrix against several right-hand sides, use LUDecomposition
+   directly and call Solve for each of them. Large systems should pass
+   SolverOptions to get the blocked, multithreaded factorization. */
 template<class T>
-bool linear_solver(std::vector< std::vector<T> >& mat, std::vector<T>& vec)
+bool linear_solver(DenseMatrix<T>& mat, std::vector<T>& vec,
+		   const SolverOptions& options = SolverOptions())
 {
-  if(mat.size() != vec.size())
+  /* a rejected system is left as it is */
+  if(mat.Rows() != mat.Cols() || mat.Rows() != static_cast<int>(vec.size()))
     return false;
 
-  /* Combine the matrix and the vector */
-  for(int i=0; i<mat.size(); ++i)
-    mat[i].push_back(vec[i]);
-
-  /********************************************
-   ** First, get matrix into triangular form **
-   ********************************************/
-
-  /* for each row, reduce unknowns for each row in order*/
-  for(int i=0; i<mat.size(); ++i){
-    /* If the pivot is zero */
-    if(mat[i][i] == T(0)){
-      /* find the first row with mat[i][j] nonzero */
-      if(SwapRows(i, mat) == false)
-	return false;
-    }
-	
-    /* Scale the row with the pivot so the pivot becomes 1.0*/
-    ScaleRowWithPivot(i, mat);
-	
-    /* eliminate the unknown mat[i][i] for all rows under column i.
-       This is done by scaling row i with the pivot at row i2, and adding
-       that to row i2. */
-	
-    for(int i2=i+1; i2<mat.size(); ++i2){
-      /* Skip rows that are already reduced */
-      if(mat[i2][i] == T(0))
-	continue;
-
-      T scale = T(mat[i2][i]) / T(mat[i][i]);
-	  
-      /* Make sure our rows are of the same length */
-      if(mat[i2].size() != mat[i].size())
-	return false;
-
-      for(int j=0; j<mat[i2].size(); ++j){
-	mat[i2][j] -= (mat[i][j] * scale);
-      }
-    }
-  }
-
-  /***********************************************************************
-   ** Matrix is now in triangular form, now we can do back-substitution **
-   ***********************************************************************/
-  BackSubstitution(mat);
+  LUDecomposition<T> lu(options);
+  bool ok = lu.FactorInPlace(mat) && lu.Solve(vec);
+  lu.Release(mat);
+  return ok;
+}
 
-  for(int i=0; i<vec.size(); ++i)
-    vec[i] = mat[i][mat.size()];
+/* Adapter for a matrix stored as a vector of rows. The matrix is copied
+   into a DenseMatrix and is left untouched. */
+template<class T>
+bool linear_solver(std::vector< std::vector<T> >& mat, std::vector<T>& vec,
+		   const SolverOptions& options = SolverOptions())
+{
+  if(mat.size() != vec.size())
+    return false;
+  for(size_t i=0; i<mat.size(); ++i){
+    if(mat[i].size() != mat.size())
+      return false;
+  }
 
-  return true;
+  DenseMatrix<T> dense(mat);
+  return linear_solver(dense, vec, options);
 }
+
+#endif
@@ -0,0 +1,446 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LU_DECOMPOSITION_HPP_GUARD
+#define LU_DECOMPOSITION_HPP_GUARD
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include "dense_matrix.hpp"
+#include "row_kernels.hpp"
+#include "solver_stats.hpp"
+#include "../threadpool/threadpool.hpp"
+
+template<class T> class Fraction;
+
+/* Decides which candidate becomes the pivot of a column.
+   Floating-point like types use partial pivoting (largest magnitude wins),
+   which keeps the rounding errors of the elimination bounded. */
+template<class T> struct PivotTraits
+{
+  static constexpr T Magnitude(const T& v)
+  {
+    return (v < T(0)) ? T(0) - v : v;
+  }
+  static constexpr bool Better(const T& candidate, const T& current)
+  {
+    return Magnitude(current) < Magnitude(candidate);
+  }
+};
+
+/* Fractions are exact and have no ordering, so any nonzero pivot will do. */
+template<class T> struct PivotTraits< Fraction<T> >
+{
+  static bool Better(const Fraction<T>& candidate, const Fraction<T>& current)
+  {
+    return current == Fraction<T>(0) && candidate != Fraction<T>(0);
+  }
+};
+
+/* Tuning knobs for the factorization of large matrices.
+   The matrix is factored in panels of blockSize columns. After each panel,
+   the rest of the matrix (the trailing matrix) is updated in tiles of
+   blockSize rows, with the tile width chosen so that a tile and the panel
+   rows it reads fit in cacheSize bytes. The tiles are spread over a thread
+   pool: pass one in pool to share it between calls, otherwise a pool of
+   threads workers is created for the duration of the factorization.
+   stats is filled in if the code is built with -DLINEAR_SOLVER_STATS, see
+   solver_stats.hpp. */
+struct SolverOptions
+{
+  int blockSize;      /* panel width, the whole matrix is one panel if <= 0 */
+  int threads;        /* 0 means one per hardware thread */
+  size_t cacheSize;   /* per-core cache budget of a tile, in bytes (L2) */
+  ThreadPool* pool;
+  SolverStats* stats;
+
+  SolverOptions() : blockSize(64), threads(1), cacheSize(256*1024), pool(0), stats(0){}
+};
+
+/* LU factorization with partial pivoting, PA = LU.
+   L (unit diagonal, not stored) and U share one NxN DenseMatrix, and the
+   row permutation P is kept as a list of row indices. Pivoting swaps row
+   pointers only. Factor once in O(N^3), then call Solve for each
+   right-hand side in O(N^2). See SolverOptions for the blocked and
+   multithreaded factorization of large matrices. */
+template<class T> class LUDecomposition
+{
+  DenseMatrix<T> lu;
+  std::vector<int> perm;
+  SolverOptions options;
+  int n;
+  bool factored;
+public:
+  LUDecomposition() : n(0), factored(false){}
+  explicit LUDecomposition(const SolverOptions& opts) : options(opts), n(0), factored(false){}
+  explicit LUDecomposition(const std::vector< std::vector<T> >& mat) : n(0), factored(false)
+  {
+    Factor(mat);
+  }
+  explicit LUDecomposition(const DenseMatrix<T>& mat) : n(0), factored(false)
+  {
+    Factor(mat);
+  }
+
+  int Size() const { return n; }
+  bool IsFactored() const { return factored; }
+  const std::vector<int>& Permutation() const { return perm; }
+
+  const SolverOptions& Options() const { return options; }
+  void SetOptions(const SolverOptions& opts) { options = opts; }
+
+  /* The combined LU factors, rows in pivot order */
+  const DenseMatrix<T>& Factors() const { return lu; }
+
+  /* Copies the NxN matrix and factors it.
+     Returns false if the matrix is not square or is singular. */
+  bool Factor(const std::vector< std::vector<T> >& mat)
+  {
+    factored = false;
+    for(size_t i=0; i<mat.size(); ++i){
+      if(mat[i].size() != mat.size())
+	return false;
+    }
+    lu.Assign(mat);
+    return FactorMatrix();
+  }
+
+  bool Factor(const DenseMatrix<T>& mat)
+  {
+    factored = false;
+    if(mat.Rows() != mat.Cols())
+      return false;
+    lu = mat;
+    return FactorMatrix();
+  }
+
+  /* Factors mat without copying it. The storage of mat is taken over,
+     and mat is left empty. Use Release to get the factors back. */
+  bool FactorInPlace(DenseMatrix<T>& mat)
+  {
+    factored = false;
+    if(mat.Rows() != mat.Cols())
+      return false;
+    DenseMatrix<T>().Swap(lu);
+    lu.Swap(mat);
+    return FactorMatrix();
+  }
+
+  /* Hands the factored matrix back to the caller, leaving this object empty */
+  void Release(DenseMatrix<T>& mat)
+  {
+    mat.Swap(lu);
+    DenseMatrix<T>().Swap(lu);
+    perm.clear();
+    n = 0;
+    factored = false;
+  }
+
+  /* Solves Ax = b in place. vec holds b on entry, and x on success. */
+  bool Solve(std::vector<T>& vec) const
+  {
+    if(!factored || static_cast<int>(vec.size()) != n)
+      return false;
+    /* nothing to solve, and no x[0] to hand to SolvePermuted */
+    if(n == 0)
+      return true;
+    SolverStats* stats = Stats();
+    SolverStatsTimer timer(stats ? &stats->substitutionTime : 0);
+    if(stats){
+      ++stats->solves;
+      stats->flops += 2.0 * n * n - n;
+    }
+    std::vector<T> x(n);
+    for(int i=0; i<n; ++i)
+      x[i] = vec[perm[i]];
+    SolvePermuted(&x[0]);
+    vec.swap(x);
+    return true;
+  }
+
+  /* Solves for several right-hand sides, each stored as a vector */
+  bool Solve(std::vector< std::vector<T> >& vecs) const
+  {
+    for(size_t i=0; i<vecs.size(); ++i){
+      if(Solve(vecs[i]) == false)
+	return false;
+    }
+    return true;
+  }
+
+  /* Estimate of |inv(A)| in the 1-norm, by Hager's method: a few solves
+     with A and A' instead of forming the inverse. The estimate is a lower
+     bound, and rarely off by more than a factor of 3. Times the 1-norm of A
+     (the largest column sum), it estimates the condition number, where
+     values near 1/epsilon of T mean the solution can't be trusted.
+     Returns 0 if nothing is factored. */
+  double InverseNormEstimate() const
+  {
+    if(!factored || n == 0)
+      return 0.0;
+    std::vector<T> x(n, T(1) / T(n));
+    std::vector<T> y(n), z(n);
+    double estimate = 0.0;
+    for(int iteration=0; iteration<5; ++iteration){
+      /* y = inv(A) x */
+      for(int i=0; i<n; ++i)
+	y[i] = x[perm[i]];
+      SolvePermuted(&y[0]);
+      double norm = 0.0;
+      for(int i=0; i<n; ++i)
+	norm += StatsTraits<T>::Magnitude(y[i]);
+      if(iteration > 0 && norm <= estimate)
+	break;
+      estimate = norm;
+
+      /* z = inv(A)' sign(y), its largest entry picks the next unit vector */
+      for(int i=0; i<n; ++i)
+	z[i] = (StatsTraits<T>::Value(y[i]) < 0.0) ? T(-1) : T(1);
+      SolveTransposed(z);
+      int j = 0;
+      double zx = 0.0;
+      for(int i=0; i<n; ++i){
+	zx += StatsTraits<T>::Value(z[i]) * StatsTraits<T>::Value(x[i]);
+	if(StatsTraits<T>::Magnitude(z[i]) > StatsTraits<T>::Magnitude(z[j]))
+	  j = i;
+      }
+      if(StatsTraits<T>::Magnitude(z[j]) <= zx)
+	break;
+      x.assign(n, T(0));
+      x[j] = T(1);
+    }
+    return estimate;
+  }
+
+private:
+  /* The stats to record into, never any without LINEAR_SOLVER_STATS, so
+     the recording is optimized away */
+  SolverStats* Stats() const
+  {
+#if defined(LINEAR_SOLVER_STATS)
+    return options.stats;
+#else
+    return 0;
+#endif
+  }
+
+  bool FactorMatrix()
+  {
+    n = lu.Rows();
+    perm.resize(n);
+    for(int i=0; i<n; ++i)
+      perm[i] = i;
+
+    SolverStats* stats = Stats();
+    double norm1 = 0.0;
+    if(stats){
+      ++stats->factorizations;
+      stats->failedColumn = -1;
+      stats->conditionEstimate = 0.0;
+      /* the largest column sum, for the condition number */
+      std::vector<double> colsum(n, 0.0);
+      for(int i=0; i<n; ++i){
+	for(int j=0; j<n; ++j)
+	  colsum[j] += StatsTraits<T>::Magnitude(lu[i][j]);
+      }
+      if(n > 0)
+	norm1 = *std::max_element(colsum.begin(), colsum.end());
+    }
+    {
+      SolverStatsTimer timer(stats ? &stats->eliminationTime : 0);
+      if(FactorBlocked() == false)
+	return false;
+    }
+    if(stats)
+      stats->conditionEstimate = norm1 * InverseNormEstimate();
+    return true;
+  }
+
+  bool FactorBlocked()
+  {
+    int nb = options.blockSize;
+    if(nb <= 0 || nb > n)
+      nb = n;
+
+    ThreadPool* pool = options.pool;
+    std::unique_ptr<ThreadPool> ownPool;
+    if(pool == 0 && options.threads != 1 && n > nb){
+      ownPool.reset(new ThreadPool(options.threads > 0 ? options.threads : 0));
+      pool = ownPool.get();
+    }
+
+    for(int k0=0; k0<n; k0+=nb){
+      int k1 = std::min(k0 + nb, n);
+      if(FactorPanel(k0, k1) == false)
+	return false;
+      if(k1 < n)
+	UpdateTrailing(k0, k1, pool);
+    }
+    factored = true;
+    return true;
+  }
+
+  /* Unblocked factorization of the panel made of columns [k0,k1) and
+     rows [k0,n). Pivot rows are swapped in full, so the columns left and
+     right of the panel follow along. */
+  bool FactorPanel(int k0, int k1)
+  {
+    for(int k=k0; k<k1; ++k){
+      /* find the pivot for column k */
+      int p = k;
+      for(int i=k+1; i<n; ++i){
+	if(PivotTraits<T>::Better(lu[i][k], lu[p][k]))
+	  p = i;
+      }
+      SolverStats* stats = Stats();
+      if(lu[p][k] == T(0)){
+	if(stats)
+	  stats->failedColumn = k;
+	return false;
+      }
+
+      if(p != k){
+	SolverStatsTimer timer(stats ? &stats->swapTime : 0);
+	lu.SwapRows(k, p);
+	std::swap(perm[k], perm[p]);
+	if(stats)
+	  ++stats->rowSwaps;
+      }
+      if(stats){
+	stats->AddPivot(StatsTraits<T>::Magnitude(lu[k][k]));
+	stats->flops += (n - k - 1) * (2.0 * (k1 - k - 1) + 1.0);
+      }
+
+      /* eliminate column k below the pivot, storing the multipliers in L */
+      const T* rowk = lu[k];
+      T pivot = rowk[k];
+      for(int i=k+1; i<n; ++i){
+	T* rowi = lu[i];
+	if(rowi[k] == T(0))
+	  continue;
+	T scale = rowi[k] / pivot;
+	rowi[k] = scale;
+	RowAxpy(rowi + k + 1, rowk + k + 1, scale, k1 - k - 1);
+      }
+    }
+    return true;
+  }
+
+  /* Applies the panel [k0,k1) to the columns right of it:
+     U12 = inv(L11) * A12, then A22 -= L21 * U12, one tile at a time. */
+  void UpdateTrailing(int k0, int k1, ThreadPool* pool)
+  {
+    int nb = k1 - k0;
+    int width = static_cast<int>(options.cacheSize / (sizeof(T) * 2 * nb));
+    width = std::max(16, width / 16 * 16);
+    int rowTiles = (n - k1 + nb - 1) / nb;
+    int colTiles = (n - k1 + width - 1) / width;
+    if(SolverStats* stats = Stats())
+      stats->flops += (nb - 1.0) * nb * (n - k1) + 2.0 * (n - k1) * (n - k1) * nb;
+
+    /* U12, independent per column tile */
+    RunTiles(pool, colTiles, [this, k0, k1, width](size_t c) {
+	int j0 = k1 + static_cast<int>(c) * width;
+	int j1 = std::min(j0 + width, n);
+	for(int k=k0; k<k1; ++k){
+	  const T* rowk = lu[k];
+	  for(int i=k+1; i<k1; ++i)
+	    Update(lu[i], rowk, lu[i][k], j0, j1);
+	}
+      });
+
+    /* A22, independent per tile */
+    RunTiles(pool, static_cast<size_t>(rowTiles) * colTiles, [this, k0, k1, nb, width, colTiles](size_t t) {
+	int i0 = k1 + static_cast<int>(t / colTiles) * nb;
+	int i1 = std::min(i0 + nb, n);
+	int j0 = k1 + static_cast<int>(t % colTiles) * width;
+	int j1 = std::min(j0 + width, n);
+	for(int i=i0; i<i1; ++i){
+	  T* rowi = lu[i];
+	  for(int k=k0; k<k1; ++k)
+	    Update(rowi, lu[k], rowi[k], j0, j1);
+	}
+      });
+  }
+
+  /* dst[j] -= src[j] * scale for j in [j0,j1) */
+  static void Update(T* dst, const T* src, T scale, int j0, int j1)
+  {
+    if(scale == T(0))
+      return;
+    RowAxpy(dst + j0, src + j0, scale, j1 - j0);
+  }
+
+  template<class F>
+  static void RunTiles(ThreadPool* pool, size_t count, F f)
+  {
+    if(pool == 0 || count < 2){
+      for(size_t i=0; i<count; ++i)
+	f(i);
+      return;
+    }
+    pool->ParallelFor(0, count, 1, [&f](size_t first, size_t last) {
+	for(size_t i=first; i<last; ++i)
+	  f(i);
+      });
+  }
+
+  /* x = inv(A)' x, with A' = U' L' P */
+  void SolveTransposed(std::vector<T>& x) const
+  {
+    /* U'y = x, the rows of U are the columns of U' */
+    for(int i=0; i<n; ++i){
+      x[i] /= lu[i][i];
+      RowAxpy(&x[0] + i + 1, lu[i] + i + 1, x[i], n - i - 1);
+    }
+    /* L'z = y */
+    for(int i=n-1; i>0; --i)
+      RowAxpy(&x[0], lu[i], x[i], i);
+    std::vector<T> tmp(n);
+    for(int i=0; i<n; ++i)
+      tmp[perm[i]] = x[i];
+    x.swap(tmp);
+  }
+
+  /* Forward and back substitution on an already permuted right-hand side */
+  void SolvePermuted(T* x) const
+  {
+    /* Ly = Pb, L has an implicit unit diagonal */
+    for(int i=1; i<n; ++i)
+      x[i] -= RowDot(lu[i], x, i);
+    /* Ux = y */
+    for(int i=n-1; i>=0; --i){
+      const T* row = lu[i];
+      T sum = x[i];
+      sum -= RowDot(row + i + 1, x + i + 1, n - i - 1);
+      x[i] = sum / row[i];
+    }
+  }
+};
+
+#endif
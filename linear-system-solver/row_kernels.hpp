@@ -0,0 +1,416 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ROW_KERNELS_HPP_GUARD
+#define ROW_KERNELS_HPP_GUARD
+
+/* Row kernels for the inner loops of the solver:
+     RowAxpy: dst[j] -= src[j] * scale
+     RowDot:  sum of a[j] * b[j]
+   float and double use SSE2, AVX2+FMA or AVX-512 code, picked at runtime
+   from CPUID, so one binary runs on every x86-64 host. Every other type
+   (Fraction, Fixed, ..) uses the plain templates. Define
+   ROW_KERNELS_NO_SIMD to always use the plain loops. */
+
+#if !defined(ROW_KERNELS_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64)) && \
+  (defined(__GNUC__) || defined(_MSC_VER))
+#define ROW_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(ROW_KERNELS_X86) && defined(__GNUC__)
+#define ROW_KERNELS_TARGET(x) __attribute__((target(x)))
+#else
+#define ROW_KERNELS_TARGET(x)
+#endif
+
+enum RowKernelLevel
+{
+  ROW_KERNELS_SCALAR = 0,
+  ROW_KERNELS_SSE2,
+  ROW_KERNELS_AVX2,
+  ROW_KERNELS_AVX512
+};
+
+template<class T>
+inline void RowAxpy(T* dst, const T* src, T scale, int count)
+{
+  for(int j=0; j<count; ++j)
+    dst[j] -= src[j] * scale;
+}
+
+template<class T>
+inline T RowDot(const T* a, const T* b, int count)
+{
+  T sum = T(0);
+  for(int j=0; j<count; ++j)
+    sum += a[j] * b[j];
+  return sum;
+}
+
+#if defined(ROW_KERNELS_X86)
+
+/* Highest instruction set that both the CPU and the OS (saved AVX state) support */
+inline RowKernelLevel DetectRowKernelLevel()
+{
+  unsigned r1[4] = {0, 0, 0, 0}, r7[4] = {0, 0, 0, 0};
+  unsigned long long xcr0 = 0;
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  unsigned maxLeaf = info[0];
+  __cpuidex(info, 1, 0);
+  for(int i=0; i<4; ++i) r1[i] = info[i];
+  if(maxLeaf >= 7){
+    __cpuidex(info, 7, 0);
+    for(int i=0; i<4; ++i) r7[i] = info[i];
+  }
+  if(r1[2] & (1u << 27))
+    xcr0 = _xgetbv(0);
+#else
+  unsigned maxLeaf = __get_cpuid_max(0, 0);
+  __cpuid_count(1, 0, r1[0], r1[1], r1[2], r1[3]);
+  if(maxLeaf >= 7)
+    __cpuid_count(7, 0, r7[0], r7[1], r7[2], r7[3]);
+  if(r1[2] & (1u << 27)){
+    unsigned lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    xcr0 = (static_cast<unsigned long long>(hi) << 32) | lo;
+  }
+#endif
+  bool ymm = (xcr0 & 0x6) == 0x6;
+  bool zmm = (xcr0 & 0xe6) == 0xe6;
+  bool fma = (r1[2] & (1u << 12)) != 0;
+  bool avx2 = (r7[1] & (1u << 5)) != 0;
+  bool avx512f = (r7[1] & (1u << 16)) != 0;
+
+  if(ymm && zmm && avx512f)
+    return ROW_KERNELS_AVX512;
+  if(ymm && avx2 && fma)
+    return ROW_KERNELS_AVX2;
+  return ROW_KERNELS_SSE2;
+}
+
+/* SSE2 is part of x86-64, so these need no target attribute */
+inline void RowAxpySSE2(float* dst, const float* src, float scale, int count)
+{
+  __m128 s = _mm_set1_ps(scale);
+  int j = 0;
+  for(; j+8<=count; j+=8){
+    __m128 d0 = _mm_sub_ps(_mm_loadu_ps(dst+j), _mm_mul_ps(_mm_loadu_ps(src+j), s));
+    __m128 d1 = _mm_sub_ps(_mm_loadu_ps(dst+j+4), _mm_mul_ps(_mm_loadu_ps(src+j+4), s));
+    _mm_storeu_ps(dst+j, d0);
+    _mm_storeu_ps(dst+j+4, d1);
+  }
+  for(; j<count; ++j)
+    dst[j] -= src[j] * scale;
+}
+
+inline void RowAxpySSE2(double* dst, const double* src, double scale, int count)
+{
+  __m128d s = _mm_set1_pd(scale);
+  int j = 0;
+  for(; j+4<=count; j+=4){
+    __m128d d0 = _mm_sub_pd(_mm_loadu_pd(dst+j), _mm_mul_pd(_mm_loadu_pd(src+j), s));
+    __m128d d1 = _mm_sub_pd(_mm_loadu_pd(dst+j+2), _mm_mul_pd(_mm_loadu_pd(src+j+2), s));
+    _mm_storeu_pd(dst+j, d0);
+    _mm_storeu_pd(dst+j+2, d1);
+  }
+  for(; j<count; ++j)
+    dst[j] -= src[j] * scale;
+}
+
+inline float RowDotSSE2(const float* a, const float* b, int count)
+{
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  int j = 0;
+  for(; j+8<=count; j+=8){
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a+j), _mm_loadu_ps(b+j)));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a+j+4), _mm_loadu_ps(b+j+4)));
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, _mm_add_ps(s0, s1));
+  float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  for(; j<count; ++j)
+    sum += a[j] * b[j];
+  return sum;
+}
+
+inline double RowDotSSE2(const double* a, const double* b, int count)
+{
+  __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+  int j = 0;
+  for(; j+4<=count; j+=4){
+    s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a+j), _mm_loadu_pd(b+j)));
+    s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a+j+2), _mm_loadu_pd(b+j+2)));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(s0, s1));
+  double sum = lanes[0] + lanes[1];
+  for(; j<count; ++j)
+    sum += a[j] * b[j];
+  return sum;
+}
+
+ROW_KERNELS_TARGET("avx2,fma")
+inline void RowAxpyAVX2(float* dst, const float* src, float scale, int count)
+{
+  __m256 s = _mm256_set1_ps(scale);
+  int j = 0;
+  for(; j+16<=count; j+=16){
+    __m256 d0 = _mm256_fnmadd_ps(_mm256_loadu_ps(src+j), s, _mm256_loadu_ps(dst+j));
+    __m256 d1 = _mm256_fnmadd_ps(_mm256_loadu_ps(src+j+8), s, _mm256_loadu_ps(dst+j+8));
+    _mm256_storeu_ps(dst+j, d0);
+    _mm256_storeu_ps(dst+j+8, d1);
+  }
+  for(; j<count; ++j)
+    dst[j] -= src[j] * scale;
+}
+
+ROW_KERNELS_TARGET("avx2,fma")
+inline void RowAxpyAVX2(double* dst, const double* src, double scale, int count)
+{
+  __m256d s = _mm256_set1_pd(scale);
+  int j = 0;
+  for(; j+8<=count; j+=8){
+    __m256d d0 = _mm256_fnmadd_pd(_mm256_loadu_pd(src+j), s, _mm256_loadu_pd(dst+j));
+    __m256d d1 = _mm256_fnmadd_pd(_mm256_loadu_pd(src+j+4), s, _mm256_loadu_pd(dst+j+4));
+    _mm256_storeu_pd(dst+j, d0);
+    _mm256_storeu_pd(dst+j+4, d1);
+  }
+  for(; j<count; ++j)
+    dst[j] -= src[j] * scale;
+}
+
+/* Horizontal sums, also used by the AVX-512 kernels on the two halves added together */
+ROW_KERNELS_TARGET("avx2,fma")
+inline float RowSumAVX2(__m256 s)
+{
+  __m128 h = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+  h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+  return _mm_cvtss_f32(h);
+}
+
+ROW_KERNELS_TARGET("avx2,fma")
+inline double RowSumAVX2(__m256d s)
+{
+  __m128d h = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+  h = _mm_add_sd(h, _mm_unpackhi_pd(h, h));
+  return _mm_cvtsd_f64(h);
+}
+
+ROW_KERNELS_TARGET("avx2,fma")
+inline float RowDotAVX2(const float* a, const float* b, int count)
+{
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  int j = 0;
+  for(; j+16<=count; j+=16){
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a+j), _mm256_loadu_ps(b+j), s0);
+    s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a+j+8), _mm256_loadu_ps(b+j+8), s1);
+  }
+  float sum = RowSumAVX2(_mm256_add_ps(s0, s1));
+  for(; j<count; ++j)
+    sum += a[j] * b[j];
+  return sum;
+}
+
+ROW_KERNELS_TARGET("avx2,fma")
+inline double RowDotAVX2(const double* a, const double* b, int count)
+{
+  __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+  int j = 0;
+  for(; j+8<=count; j+=8){
+    s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a+j), _mm256_loadu_pd(b+j), s0);
+    s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a+j+4), _mm256_loadu_pd(b+j+4), s1);
+  }
+  double sum = RowSumAVX2(_mm256_add_pd(s0, s1));
+  for(; j<count; ++j)
+    sum += a[j] * b[j];
+  return sum;
+}
+
+/* The AVX-512 kernels handle the tail with a masked load/store instead of a scalar loop */
+ROW_KERNELS_TARGET("avx512f")
+inline void RowAxpyAVX512(float* dst, const float* src, float scale, int count)
+{
+  __m512 s = _mm512_set1_ps(scale);
+  int j = 0;
+  for(; j+16<=count; j+=16)
+    _mm512_storeu_ps(dst+j, _mm512_fnmadd_ps(_mm512_loadu_ps(src+j), s, _mm512_loadu_ps(dst+j)));
+  if(j < count){
+    __mmask16 m = static_cast<__mmask16>((1u << (count - j)) - 1);
+    __m512 d = _mm512_maskz_loadu_ps(m, dst+j);
+    _mm512_mask_storeu_ps(dst+j, m, _mm512_fnmadd_ps(_mm512_maskz_loadu_ps(m, src+j), s, d));
+  }
+}
+
+ROW_KERNELS_TARGET("avx512f")
+inline void RowAxpyAVX512(double* dst, const double* src, double scale, int count)
+{
+  __m512d s = _mm512_set1_pd(scale);
+  int j = 0;
+  for(; j+8<=count; j+=8)
+    _mm512_storeu_pd(dst+j, _mm512_fnmadd_pd(_mm512_loadu_pd(src+j), s, _mm512_loadu_pd(dst+j)));
+  if(j < count){
+    __mmask8 m = static_cast<__mmask8>((1u << (count - j)) - 1);
+    __m512d d = _mm512_maskz_loadu_pd(m, dst+j);
+    _mm512_mask_storeu_pd(dst+j, m, _mm512_fnmadd_pd(_mm512_maskz_loadu_pd(m, src+j), s, d));
+  }
+}
+
+ROW_KERNELS_TARGET("avx512f")
+inline float RowDotAVX512(const float* a, const float* b, int count)
+{
+  __m512 s = _mm512_setzero_ps();
+  int j = 0;
+  for(; j+16<=count; j+=16)
+    s = _mm512_fmadd_ps(_mm512_loadu_ps(a+j), _mm512_loadu_ps(b+j), s);
+  if(j < count){
+    __mmask16 m = static_cast<__mmask16>((1u << (count - j)) - 1);
+    s = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a+j), _mm512_maskz_loadu_ps(m, b+j), s);
+  }
+  /* Halves taken with zero-masked extracts: _mm512_reduce_add_ps, the
+     512 to 256 bit casts and the unmasked extract all read an undefined
+     register in GCC 12's headers, which -Wall warns about */
+  __m512d d = _mm512_castps_pd(s);
+  __m256 lo = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xFF, d, 0));
+  __m256 hi = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xFF, d, 1));
+  return RowSumAVX2(_mm256_add_ps(lo, hi));
+}
+
+ROW_KERNELS_TARGET("avx512f")
+inline double RowDotAVX512(const double* a, const double* b, int count)
+{
+  __m512d s = _mm512_setzero_pd();
+  int j = 0;
+  for(; j+8<=count; j+=8)
+    s = _mm512_fmadd_pd(_mm512_loadu_pd(a+j), _mm512_loadu_pd(b+j), s);
+  if(j < count){
+    __mmask8 m = static_cast<__mmask8>((1u << (count - j)) - 1);
+    s = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, a+j), _mm512_maskz_loadu_pd(m, b+j), s);
+  }
+  __m256d lo = _mm512_maskz_extractf64x4_pd(0xFF, s, 0);
+  __m256d hi = _mm512_maskz_extractf64x4_pd(0xFF, s, 1);
+  return RowSumAVX2(_mm256_add_pd(lo, hi));
+}
+
+/* Function table for one element type, filled in once from CPUID */
+template<class T> struct RowKernelTable
+{
+  void (*axpy)(T*, const T*, T, int);
+  T (*dot)(const T*, const T*, int);
+  RowKernelLevel level;
+
+  void Select(RowKernelLevel want)
+  {
+    level = want;
+    switch(want){
+    case ROW_KERNELS_AVX512:
+      axpy = &RowAxpyAVX512; dot = &RowDotAVX512; break;
+    case ROW_KERNELS_AVX2:
+      axpy = &RowAxpyAVX2; dot = &RowDotAVX2; break;
+    case ROW_KERNELS_SSE2:
+      axpy = &RowAxpySSE2; dot = &RowDotSSE2; break;
+    default:
+      level = ROW_KERNELS_SCALAR;
+      axpy = &RowAxpy<T>; dot = &RowDot<T>; break;
+    }
+  }
+
+  static RowKernelTable<T>& Get()
+  {
+    static RowKernelTable<T> table = Create();
+    return table;
+  }
+
+private:
+  static RowKernelTable<T> Create()
+  {
+    RowKernelTable<T> t;
+    t.Select(DetectRowKernelLevel());
+    return t;
+  }
+};
+
+inline void RowAxpy(float* dst, const float* src, float scale, int count)
+{
+  RowKernelTable<float>::Get().axpy(dst, src, scale, count);
+}
+
+inline void RowAxpy(double* dst, const double* src, double scale, int count)
+{
+  RowKernelTable<double>::Get().axpy(dst, src, scale, count);
+}
+
+inline float RowDot(const float* a, const float* b, int count)
+{
+  return RowKernelTable<float>::Get().dot(a, b, count);
+}
+
+inline double RowDot(const double* a, const double* b, int count)
+{
+  return RowKernelTable<double>::Get().dot(a, b, count);
+}
+
+/* The instruction set the kernels are using */
+inline RowKernelLevel GetRowKernelLevel()
+{
+  return RowKernelTable<double>::Get().level;
+}
+
+/* Forces the kernels down to a lower level, for benchmarks and testing.
+   Asking for more than the CPU supports selects the detected level.
+   Not thread safe, call it before any solver runs. */
+inline void SetRowKernelLevel(RowKernelLevel level)
+{
+  RowKernelLevel best = DetectRowKernelLevel();
+  if(level > best)
+    level = best;
+  RowKernelTable<float>::Get().Select(level);
+  RowKernelTable<double>::Get().Select(level);
+}
+
+#else
+
+inline RowKernelLevel GetRowKernelLevel()
+{
+  return ROW_KERNELS_SCALAR;
+}
+
+inline void SetRowKernelLevel(RowKernelLevel)
+{
+}
+
+#endif
+
+#endif
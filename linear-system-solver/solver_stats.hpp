@@ -0,0 +1,150 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SOLVER_STATS_HPP_GUARD
+#define SOLVER_STATS_HPP_GUARD
+
+#include <chrono>
+#include <type_traits>
+
+template<class T> class Fraction;
+
+/* What the solver did, for tuning and for finding out why it failed.
+   Point SolverOptions::stats at one of these, and build with
+   -DLINEAR_SOLVER_STATS. Without the define, nothing is recorded and the
+   instrumentation compiles away. The numbers add up over calls until
+   Reset is called. */
+struct SolverStats
+{
+  double eliminationTime;    /* seconds in the factorization, swaps included */
+  double swapTime;           /* seconds spent swapping rows */
+  double substitutionTime;   /* seconds in forward and back substitution */
+  double flops;              /* floating-point operations, counted as if dense */
+  long rowSwaps;
+  long factorizations;
+  long solves;
+  double minPivot;           /* smallest and largest pivot magnitude */
+  double maxPivot;
+  double conditionEstimate;  /* of the last matrix factored, 1-norm */
+  int failedColumn;          /* column without a pivot, -1 if none */
+
+  SolverStats(){ Reset(); }
+
+  void Reset()
+  {
+    eliminationTime = swapTime = substitutionTime = 0.0;
+    flops = 0.0;
+    rowSwaps = factorizations = solves = 0;
+    minPivot = maxPivot = 0.0;
+    conditionEstimate = 0.0;
+    failedColumn = -1;
+  }
+
+  void AddPivot(double magnitude)
+  {
+    if(minPivot == 0.0 && maxPivot == 0.0)
+      minPivot = maxPivot = magnitude;
+    else if(magnitude < minPivot)
+      minPivot = magnitude;
+    else if(magnitude > maxPivot)
+      maxPivot = magnitude;
+  }
+
+  /* Calls f(name, value) for every number, for handing them on to some
+     metrics or logging system */
+  template<class F> void Visit(F f) const
+  {
+    f("elimination_seconds", eliminationTime);
+    f("swap_seconds", swapTime);
+    f("substitution_seconds", substitutionTime);
+    f("flops", flops);
+    f("row_swaps", static_cast<double>(rowSwaps));
+    f("factorizations", static_cast<double>(factorizations));
+    f("solves", static_cast<double>(solves));
+    f("min_pivot", minPivot);
+    f("max_pivot", maxPivot);
+    f("condition_estimate", conditionEstimate);
+    f("failed_column", static_cast<double>(failedColumn));
+  }
+};
+
+/* Adds the time from construction to destruction to *seconds, if the
+   pointer is set */
+class SolverStatsTimer
+{
+  double* seconds;
+  std::chrono::steady_clock::time_point start;
+public:
+  explicit SolverStatsTimer(double* s) : seconds(s)
+  {
+    if(seconds)
+      start = std::chrono::steady_clock::now();
+  }
+  ~SolverStatsTimer()
+  {
+    if(seconds)
+      *seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+};
+
+/* A value as a double, for the magnitudes in the stats. Types that don't
+   convert to double count as zero. */
+template<class T> struct StatsTraits
+{
+  static double Value(const T& v)
+  {
+    return Convert(v, std::is_convertible<T, double>());
+  }
+  static double Convert(const T& v, std::true_type)
+  {
+    return static_cast<double>(v);
+  }
+  static double Convert(const T&, std::false_type)
+  {
+    return 0.0;
+  }
+  static double Magnitude(const T& v)
+  {
+    double d = Value(v);
+    return d < 0.0 ? -d : d;
+  }
+};
+
+template<class T> struct StatsTraits< Fraction<T> >
+{
+  static double Value(const Fraction<T>& v)
+  {
+    return v.DividedValue();
+  }
+  static double Magnitude(const Fraction<T>& v)
+  {
+    double d = Value(v);
+    return d < 0.0 ? -d : d;
+  }
+};
+
+#endif
@@ -0,0 +1,269 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPARSE_LU_HPP_GUARD
+#define SPARSE_LU_HPP_GUARD
+
+#include <vector>
+#include "sparse_matrix.hpp"
+#include "sparse_ordering.hpp"
+#include "lu_decomposition.hpp"
+
+/* Sparse LU factorization with partial pivoting, P*A*Q = L*U.
+   The columns are first ordered to reduce fill (Q, see
+   ColumnMinimumDegree). The factorization is left-looking (Gilbert-Peierls):
+   column k of L and U comes from a sparse triangular solve with the columns
+   of L found so far, where a depth-first search finds which entries can be
+   nonzero before any arithmetic is done. The work is proportional to the
+   number of floating-point operations, so zeros are never touched. */
+template<class T> class SparseLU
+{
+public:
+  enum Ordering
+  {
+    ORDER_NATURAL,      /* Q = I */
+    ORDER_MINIMUM_DEGREE
+  };
+
+private:
+  int n;
+  bool factored;
+  /* L is unit lower triangular with the unit diagonal stored first in each
+     column, U is upper triangular with the diagonal stored last. Both use
+     pivot step indices for their rows. */
+  std::vector<int> lp, li, up, ui;
+  std::vector<T> lx, ux;
+  std::vector<int> pinv;  /* row i of A is pivot row pinv[i] */
+  std::vector<int> q;     /* column q[k] of A is column k of L*U */
+
+public:
+  SparseLU() : n(0), factored(false){}
+  explicit SparseLU(const SparseMatrix<T>& mat, Ordering ordering = ORDER_MINIMUM_DEGREE) : n(0), factored(false)
+  {
+    Factor(mat, ordering);
+  }
+
+  int Size() const { return n; }
+  bool IsFactored() const { return factored; }
+  int NonZerosL() const { return lp.empty() ? 0 : lp[n]; }
+  int NonZerosU() const { return up.empty() ? 0 : up[n]; }
+  const std::vector<int>& ColumnOrder() const { return q; }
+
+  /* Returns false if the matrix is not square or is singular */
+  bool Factor(const SparseMatrix<T>& mat, Ordering ordering = ORDER_MINIMUM_DEGREE)
+  {
+    factored = false;
+    if(mat.Rows() != mat.Cols())
+      return false;
+    n = mat.Cols();
+
+    if(ordering == ORDER_MINIMUM_DEGREE)
+      ColumnMinimumDegree(mat, q);
+    else {
+      q.resize(n);
+      for(int k=0; k<n; ++k)
+	q[k] = k;
+    }
+
+    lp.assign(n + 1, 0);
+    up.assign(n + 1, 0);
+    li.clear(); lx.clear(); ui.clear(); ux.clear();
+    li.reserve(4 * mat.NonZeros() + n);
+    lx.reserve(4 * mat.NonZeros() + n);
+    ui.reserve(4 * mat.NonZeros() + n);
+    ux.reserve(4 * mat.NonZeros() + n);
+    pinv.assign(n, -1);
+
+    std::vector<T> x(n, T(0));
+    std::vector<int> xi(2 * n);
+    std::vector<int> pstack(n);
+    std::vector<char> marked(n, 0);
+
+    for(int k=0; k<n; ++k){
+      lp[k] = static_cast<int>(li.size());
+      up[k] = static_cast<int>(ui.size());
+
+      /* x = L \ A(:,q[k]), xi[top..n) holds the nonzero pattern */
+      int col = q[k];
+      int top = Reach(mat, col, xi, pstack, marked);
+      for(int p=top; p<n; ++p)
+	x[xi[p]] = T(0);
+      for(int p=mat.ColumnBegin(col); p<mat.ColumnEnd(col); ++p)
+	x[mat.RowIndex(p)] = mat.Value(p);
+      for(int p=top; p<n; ++p){
+	int j = xi[p];
+	int J = pinv[j];
+	if(J < 0)
+	  continue;
+	/* x[j] is final, apply column J of L. Its rows are still original
+	   row indices until the factorization is done. */
+	T xj = x[j];
+	for(int r=lp[J]+1; r<lp[J+1]; ++r)
+	  x[li[r]] -= lx[r] * xj;
+      }
+
+      /* pick the pivot among the rows not pivoted yet, store U(:,k) */
+      int ipiv = -1;
+      for(int p=top; p<n; ++p){
+	int i = xi[p];
+	if(pinv[i] < 0){
+	  if(ipiv < 0 || PivotTraits<T>::Better(x[i], x[ipiv]))
+	    ipiv = i;
+	} else {
+	  ui.push_back(pinv[i]);
+	  ux.push_back(x[i]);
+	}
+      }
+      if(ipiv < 0 || x[ipiv] == T(0))
+	return false;
+
+      T pivot = x[ipiv];
+      ui.push_back(k);
+      ux.push_back(pivot);
+      pinv[ipiv] = k;
+
+      /* L(:,k), unit diagonal first */
+      li.push_back(ipiv);
+      lx.push_back(T(1));
+      for(int p=top; p<n; ++p){
+	int i = xi[p];
+	if(pinv[i] < 0 && x[i] != T(0)){
+	  li.push_back(i);
+	  lx.push_back(x[i] / pivot);
+	}
+	x[i] = T(0);
+      }
+    }
+    lp[n] = static_cast<int>(li.size());
+    up[n] = static_cast<int>(ui.size());
+
+    /* renumber the rows of L to pivot order */
+    for(size_t p=0; p<li.size(); ++p)
+      li[p] = pinv[li[p]];
+
+    factored = true;
+    return true;
+  }
+
+  /* Solves Ax = b in place. vec holds b on entry, and x on success. */
+  bool Solve(std::vector<T>& vec) const
+  {
+    if(!factored || static_cast<int>(vec.size()) != n)
+      return false;
+    std::vector<T> y(n);
+    for(int i=0; i<n; ++i)
+      y[pinv[i]] = vec[i];
+
+    /* Ly = Pb */
+    for(int j=0; j<n; ++j){
+      T yj = y[j];
+      if(yj == T(0))
+	continue;
+      for(int p=lp[j]+1; p<lp[j+1]; ++p)
+	y[li[p]] -= lx[p] * yj;
+    }
+    /* Uz = y */
+    for(int j=n-1; j>=0; --j){
+      y[j] /= ux[up[j+1]-1];
+      T yj = y[j];
+      if(yj == T(0))
+	continue;
+      for(int p=up[j]; p<up[j+1]-1; ++p)
+	y[ui[p]] -= ux[p] * yj;
+    }
+    /* x = Qz */
+    for(int k=0; k<n; ++k)
+      vec[q[k]] = y[k];
+    return true;
+  }
+
+private:
+  /* Nonzero pattern of L \ A(:,col), in topological order in xi[top..n).
+     Uses xi[n..2n) as the DFS stack, and pstack for the position to
+     resume each column of L at. */
+  int Reach(const SparseMatrix<T>& mat, int col, std::vector<int>& xi,
+	    std::vector<int>& pstack, std::vector<char>& marked) const
+  {
+    int top = n;
+    for(int p=mat.ColumnBegin(col); p<mat.ColumnEnd(col); ++p){
+      int start = mat.RowIndex(p);
+      if(!marked[start])
+	top = DepthFirst(start, top, xi, pstack, marked);
+    }
+    for(int p=top; p<n; ++p)
+      marked[xi[p]] = 0;
+    return top;
+  }
+
+  int DepthFirst(int start, int top, std::vector<int>& xi,
+		 std::vector<int>& pstack, std::vector<char>& marked) const
+  {
+    int* stack = &xi[n];
+    int head = 0;
+    stack[0] = start;
+    while(head >= 0){
+      int j = stack[head];
+      int J = pinv[j];
+      if(!marked[j]){
+	marked[j] = 1;
+	pstack[head] = (J < 0) ? 0 : lp[J] + 1;
+      }
+      /* rows not pivoted yet have no column in L */
+      int end = (J < 0) ? 0 : lp[J+1];
+      bool done = true;
+      for(int p=pstack[head]; p<end; ++p){
+	int i = li[p];
+	if(marked[i])
+	  continue;
+	pstack[head] = p + 1;
+	stack[++head] = i;
+	done = false;
+	break;
+      }
+      if(done){
+	--head;
+	xi[--top] = j;
+      }
+    }
+    return top;
+  }
+};
+
+/* Solves mat*x = vec for a sparse square matrix. vec holds the answer if
+   the call succeeds. */
+template<class T>
+bool linear_solver(const SparseMatrix<T>& mat, std::vector<T>& vec)
+{
+  if(mat.Rows() != static_cast<int>(vec.size()))
+    return false;
+  SparseLU<T> lu;
+  if(lu.Factor(mat) == false)
+    return false;
+  return lu.Solve(vec);
+}
+
+#endif
@@ -0,0 +1,176 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPARSE_MATRIX_HPP_GUARD
+#define SPARSE_MATRIX_HPP_GUARD
+
+#include <vector>
+#include <algorithm>
+
+/* One (row, col, value) entry, used to build a SparseMatrix */
+template<class T> struct SparseEntry
+{
+  int row, col;
+  T value;
+  SparseEntry() : row(0), col(0), value(T(0)){}
+  SparseEntry(int r, int c, const T& v) : row(r), col(c), value(v){}
+};
+
+/* Sparse matrix in compressed sparse column (CSC) form: the nonzeros of
+   column j are at positions [ColumnBegin(j), ColumnEnd(j)), sorted by row.
+   The CSC arrays of the transpose are the compressed sparse row (CSR)
+   arrays of the matrix itself, so Transpose converts between the two. */
+template<class T> class SparseMatrix
+{
+  int nrows, ncols;
+  std::vector<int> colptr;
+  std::vector<int> rowidx;
+  std::vector<T> values;
+public:
+  SparseMatrix() : nrows(0), ncols(0), colptr(1, 0){}
+  SparseMatrix(int r, int c) : nrows(r), ncols(c), colptr(c + 1, 0){}
+
+  /* Builds the matrix from entries in any order. Duplicates are summed. */
+  SparseMatrix(int r, int c, const std::vector< SparseEntry<T> >& entries) : nrows(0), ncols(0)
+  {
+    Assign(r, c, entries);
+  }
+
+  /* Takes the nonzeros of a dense matrix stored as a vector of rows */
+  explicit SparseMatrix(const std::vector< std::vector<T> >& mat) : nrows(0), ncols(0)
+  {
+    std::vector< SparseEntry<T> > entries;
+    int c = 0;
+    for(size_t i=0; i<mat.size(); ++i){
+      c = std::max(c, static_cast<int>(mat[i].size()));
+      for(size_t j=0; j<mat[i].size(); ++j){
+	if(mat[i][j] != T(0))
+	  entries.push_back(SparseEntry<T>(static_cast<int>(i), static_cast<int>(j), mat[i][j]));
+      }
+    }
+    Assign(static_cast<int>(mat.size()), c, entries);
+  }
+
+  /* Takes the compressed arrays as they are. Row indices must be sorted
+     within each column. */
+  SparseMatrix(int r, int c, const std::vector<int>& ptr, const std::vector<int>& idx, const std::vector<T>& val)
+    : nrows(r), ncols(c), colptr(ptr), rowidx(idx), values(val){}
+
+  int Rows() const { return nrows; }
+  int Cols() const { return ncols; }
+  int NonZeros() const { return colptr[ncols]; }
+
+  int ColumnBegin(int col) const { return colptr[col]; }
+  int ColumnEnd(int col) const { return colptr[col+1]; }
+  int RowIndex(int pos) const { return rowidx[pos]; }
+  const T& Value(int pos) const { return values[pos]; }
+  T& Value(int pos) { return values[pos]; }
+
+  const std::vector<int>& ColumnPointers() const { return colptr; }
+  const std::vector<int>& RowIndices() const { return rowidx; }
+  const std::vector<T>& Values() const { return values; }
+
+  void Assign(int r, int c, const std::vector< SparseEntry<T> >& entries)
+  {
+    nrows = r;
+    ncols = c;
+    colptr.assign(c + 1, 0);
+    for(size_t p=0; p<entries.size(); ++p)
+      ++colptr[entries[p].col + 1];
+    for(int j=0; j<c; ++j)
+      colptr[j+1] += colptr[j];
+
+    /* bucket by column, then sort each column by row and merge duplicates */
+    std::vector<int> next(colptr.begin(), colptr.end() - 1);
+    std::vector< std::pair<int, T> > bucket(entries.size());
+    for(size_t p=0; p<entries.size(); ++p)
+      bucket[next[entries[p].col]++] = std::make_pair(entries[p].row, entries[p].value);
+
+    rowidx.clear();
+    values.clear();
+    rowidx.reserve(entries.size());
+    values.reserve(entries.size());
+    int begin = 0;
+    for(int j=0; j<c; ++j){
+      int end = colptr[j+1];
+      std::sort(bucket.begin() + begin, bucket.begin() + end, LessRow);
+      colptr[j] = static_cast<int>(rowidx.size());
+      for(int p=begin; p<end; ++p){
+	if(p > begin && bucket[p].first == rowidx.back())
+	  values.back() += bucket[p].second;
+	else {
+	  rowidx.push_back(bucket[p].first);
+	  values.push_back(bucket[p].second);
+	}
+      }
+      begin = end;
+    }
+    colptr[c] = static_cast<int>(rowidx.size());
+  }
+
+  /* The transpose, which is also this matrix in CSR form */
+  SparseMatrix<T> Transpose() const
+  {
+    SparseMatrix<T> t(ncols, nrows);
+    t.rowidx.resize(NonZeros());
+    t.values.resize(NonZeros());
+    for(int p=0; p<NonZeros(); ++p)
+      ++t.colptr[rowidx[p] + 1];
+    for(int i=0; i<nrows; ++i)
+      t.colptr[i+1] += t.colptr[i];
+    std::vector<int> next(t.colptr.begin(), t.colptr.end() - 1);
+    for(int j=0; j<ncols; ++j){
+      for(int p=colptr[j]; p<colptr[j+1]; ++p){
+	int q = next[rowidx[p]]++;
+	t.rowidx[q] = j;
+	t.values[q] = values[p];
+      }
+    }
+    return t;
+  }
+
+  /* y = A*x */
+  void Multiply(const std::vector<T>& x, std::vector<T>& y) const
+  {
+    y.assign(nrows, T(0));
+    for(int j=0; j<ncols; ++j){
+      T xj = x[j];
+      if(xj == T(0))
+	continue;
+      for(int p=colptr[j]; p<colptr[j+1]; ++p)
+	y[rowidx[p]] += values[p] * xj;
+    }
+  }
+
+private:
+  static bool LessRow(const std::pair<int, T>& a, const std::pair<int, T>& b)
+  {
+    return a.first < b.first;
+  }
+};
+
+#endif
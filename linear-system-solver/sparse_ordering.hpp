@@ -0,0 +1,217 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPARSE_ORDERING_HPP_GUARD
+#define SPARSE_ORDERING_HPP_GUARD
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "sparse_matrix.hpp"
+
+/* Fill-reducing column ordering for sparse LU, in the style of COLAMD.
+   LU with partial pivoting of A*Q fills in no more than the Cholesky
+   factor of (A*Q)'(A*Q) does, so the columns are ordered by minimum degree
+   on the graph of A'A. That graph is never formed: every row of A is kept
+   as an element (a clique of the columns it touches), and eliminating a
+   column merges the elements it belongs to into one new element, as in a
+   quotient graph. Rows denser than 10*sqrt(n) are left out, since they
+   would make every column look equally bad.
+   q[k] is the column of A to eliminate at step k. */
+template<class T>
+void ColumnMinimumDegree(const SparseMatrix<T>& mat, std::vector<int>& q)
+{
+  int n = mat.Cols();
+  int m = mat.Rows();
+  SparseMatrix<T> rows = mat.Transpose();
+  int dense = std::max(16, static_cast<int>(10.0 * std::sqrt(static_cast<double>(n))));
+
+  std::vector< std::vector<int> > elemVars;
+  std::vector< std::vector<int> > varElems(n);
+  elemVars.reserve(m + n);
+  for(int i=0; i<m; ++i){
+    int len = rows.ColumnEnd(i) - rows.ColumnBegin(i);
+    if(len == 0 || len > dense)
+      continue;
+    int e = static_cast<int>(elemVars.size());
+    elemVars.push_back(std::vector<int>());
+    for(int p=rows.ColumnBegin(i); p<rows.ColumnEnd(i); ++p){
+      elemVars[e].push_back(rows.RowIndex(p));
+      varElems[rows.RowIndex(p)].push_back(e);
+    }
+  }
+
+  std::vector<char> eliminated(n, 0);
+  std::vector<char> alive(elemVars.size(), 1);
+  std::vector<int> mark(n, -1);
+  std::vector<int> degree(n, 0);
+  std::vector<int> w(elemVars.size(), 0);
+  std::vector<int> wstamp(elemVars.size(), -1);
+  int stamp = 0;
+
+  /* initial external degree: the number of other columns sharing a row,
+     and the degree lists */
+  struct Degree
+  {
+    static int Compute(int v, const std::vector< std::vector<int> >& elemVars,
+		       const std::vector<int>& elems, const std::vector<char>& eliminated,
+		       std::vector<int>& mark, int stamp)
+    {
+      int d = 0;
+      mark[v] = stamp;
+      for(size_t a=0; a<elems.size(); ++a){
+	const std::vector<int>& vars = elemVars[elems[a]];
+	for(size_t b=0; b<vars.size(); ++b){
+	  int u = vars[b];
+	  if(mark[u] != stamp && !eliminated[u]){
+	    mark[u] = stamp;
+	    ++d;
+	  }
+	}
+      }
+      return d;
+    }
+
+    static void Link(int v, int d, std::vector<int>& head, std::vector<int>& next, std::vector<int>& prev)
+    {
+      next[v] = head[d];
+      prev[v] = -1;
+      if(head[d] >= 0)
+	prev[head[d]] = v;
+      head[d] = v;
+    }
+
+    static void Unlink(int v, int d, std::vector<int>& head, std::vector<int>& next, std::vector<int>& prev)
+    {
+      if(prev[v] >= 0)
+	next[prev[v]] = next[v];
+      else
+	head[d] = next[v];
+      if(next[v] >= 0)
+	prev[next[v]] = prev[v];
+    }
+  };
+
+  /* the columns are kept in doubly linked lists, one per degree */
+  std::vector<int> head(n + 1, -1), next(n, -1), prev(n, -1);
+  int mindeg = n;
+  for(int v=0; v<n; ++v){
+    degree[v] = Degree::Compute(v, elemVars, varElems[v], eliminated, mark, stamp++);
+    Degree::Link(v, degree[v], head, next, prev);
+    mindeg = std::min(mindeg, degree[v]);
+  }
+
+  q.clear();
+  q.reserve(n);
+  std::vector<int> newVars;
+  while(static_cast<int>(q.size()) < n){
+    while(head[mindeg] < 0)
+      ++mindeg;
+    int v = head[mindeg];
+    Degree::Unlink(v, degree[v], head, next, prev);
+    eliminated[v] = 1;
+    q.push_back(v);
+
+    /* the new element is the union of the elements v belongs to */
+    newVars.clear();
+    ++stamp;
+    for(size_t a=0; a<varElems[v].size(); ++a){
+      int e = varElems[v][a];
+      if(!alive[e])
+	continue;
+      for(size_t b=0; b<elemVars[e].size(); ++b){
+	int u = elemVars[e][b];
+	if(mark[u] != stamp && !eliminated[u]){
+	  mark[u] = stamp;
+	  newVars.push_back(u);
+	}
+      }
+      alive[e] = 0;
+      std::vector<int>().swap(elemVars[e]);
+    }
+    std::vector<int>().swap(varElems[v]);
+    if(newVars.empty())
+      continue;
+
+    int ne = static_cast<int>(elemVars.size());
+    elemVars.push_back(newVars);
+    alive.push_back(1);
+    w.push_back(0);
+    wstamp.push_back(-1);
+
+    /* w[e] = |e \ new element| for every element next to the new one */
+    ++stamp;
+    for(size_t a=0; a<newVars.size(); ++a){
+      const std::vector<int>& elems = varElems[newVars[a]];
+      for(size_t b=0; b<elems.size(); ++b){
+	int e = elems[b];
+	if(!alive[e])
+	  continue;
+	if(wstamp[e] != stamp){
+	  wstamp[e] = stamp;
+	  w[e] = static_cast<int>(elemVars[e].size());
+	}
+	--w[e];
+      }
+    }
+
+    /* drop the absorbed elements from the neighbours, and update their
+       degree. Like AMD, the degree is approximated from above by the size
+       of the new element plus what the other elements add to it, which
+       costs a walk over the element lists instead of over the variables. */
+    int remaining = n - static_cast<int>(q.size());
+    int newSize = static_cast<int>(newVars.size());
+    for(size_t a=0; a<newVars.size(); ++a){
+      int u = newVars[a];
+      std::vector<int>& elems = varElems[u];
+      size_t keep = 0;
+      int d = newSize - 1;
+      for(size_t b=0; b<elems.size(); ++b){
+	int e = elems[b];
+	if(alive[e] && w[e] == 0){
+	  /* e is a subset of the new element, absorb it */
+	  alive[e] = 0;
+	  std::vector<int>().swap(elemVars[e]);
+	}
+	if(alive[e]){
+	  d += w[e];
+	  elems[keep++] = e;
+	}
+      }
+      elems.resize(keep);
+      elems.push_back(ne);
+
+      d = std::min(d, std::min(remaining - 1, degree[u] + newSize - 1));
+      Degree::Unlink(u, degree[u], head, next, prev);
+      degree[u] = d;
+      Degree::Link(u, d, head, next, prev);
+      mindeg = std::min(mindeg, d);
+    }
+  }
+}
+
+#endif
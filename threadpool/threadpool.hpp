@@ -0,0 +1,249 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef THREADPOOL_HPP_GUARD
+#define THREADPOOL_HPP_GUARD
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+
+/* A set of tasks that can be waited for as a whole.
+   If a task throws, the first exception is rethrown by ThreadPool::Wait. */
+class TaskGroup
+{
+  friend class ThreadPool;
+  std::atomic<size_t> pending;
+  std::mutex lock;
+  std::exception_ptr error;
+public:
+  TaskGroup() : pending(0){}
+private:
+  TaskGroup(const TaskGroup&);
+  TaskGroup& operator=(const TaskGroup&);
+};
+
+/* Work-stealing thread pool.
+   Every worker owns a task queue. Tasks spawned from a worker go to the back
+   of its own queue and are run from the back (newest first, the data is
+   still in cache), while idle workers steal from the front of the other
+   queues (oldest first, usually the biggest pieces of work).
+   Wait does not block a thread: it keeps running queued tasks until the
+   group is done, so tasks can safely spawn and wait for other tasks. */
+class ThreadPool
+{
+  struct Queue
+  {
+    std::mutex lock;
+    std::deque< std::function<void()> > tasks;
+  };
+  struct Identity
+  {
+    ThreadPool* pool;
+    unsigned index;
+  };
+
+  std::vector< std::unique_ptr<Queue> > queues;
+  std::vector<std::thread> threads;
+  std::mutex idleLock;
+  std::condition_variable idle;
+  std::atomic<size_t> queued;
+  std::atomic<unsigned> next;
+  bool stopping;
+
+public:
+  /* threads == 0 uses one worker per hardware thread */
+  explicit ThreadPool(unsigned count = 0) : queued(0), next(0), stopping(false)
+  {
+    if(count == 0)
+      count = DefaultThreads();
+    for(unsigned i=0; i<count; ++i)
+      queues.push_back(std::unique_ptr<Queue>(new Queue));
+    for(unsigned i=0; i<count; ++i)
+      threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> guard(idleLock);
+      stopping = true;
+    }
+    idle.notify_all();
+    for(size_t i=0; i<threads.size(); ++i)
+      threads[i].join();
+  }
+
+  unsigned Size() const { return static_cast<unsigned>(threads.size()); }
+
+  static unsigned DefaultThreads()
+  {
+    unsigned count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+  }
+
+  /* Queues f as part of group */
+  void Run(TaskGroup& group, std::function<void()> f)
+  {
+    ++group.pending;
+    TaskGroup* g = &group;
+    Push([g, f]() {
+	try {
+	  f();
+	} catch(...) {
+	  std::lock_guard<std::mutex> guard(g->lock);
+	  if(!g->error)
+	    g->error = std::current_exception();
+	}
+	--g->pending;
+      });
+  }
+
+  /* Runs queued tasks until every task in group has finished */
+  void Wait(TaskGroup& group)
+  {
+    unsigned self = Self();
+    while(group.pending.load() != 0){
+      if(RunOne(self) == false)
+	std::this_thread::yield();
+    }
+    if(group.error){
+      std::exception_ptr e = group.error;
+      group.error = std::exception_ptr();
+      std::rethrow_exception(e);
+    }
+  }
+
+  /* Calls f(first, last) for consecutive chunks of [begin, end), each at
+     most grain long, and waits for all of them. */
+  template<class F>
+  void ParallelFor(size_t begin, size_t end, size_t grain, F f)
+  {
+    if(grain == 0)
+      grain = 1;
+    if(end <= begin)
+      return;
+    if(end - begin <= grain){
+      f(begin, end);
+      return;
+    }
+    TaskGroup group;
+    for(size_t first=begin; first<end; first+=grain){
+      size_t last = (end - first > grain) ? first + grain : end;
+      Run(group, [f, first, last]() { f(first, last); });
+    }
+    Wait(group);
+  }
+
+private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  static Identity& Current()
+  {
+    static thread_local Identity id = { 0, 0 };
+    return id;
+  }
+
+  /* Index of the calling worker, or Size() for threads outside the pool */
+  unsigned Self() const
+  {
+    const Identity& id = Current();
+    return id.pool == this ? id.index : Size();
+  }
+
+  void Push(std::function<void()> task)
+  {
+    unsigned self = Self();
+    unsigned index = (self < Size()) ? self : (next++ % Size());
+    {
+      std::lock_guard<std::mutex> guard(queues[index]->lock);
+      queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+      std::lock_guard<std::mutex> guard(idleLock);
+      ++queued;
+    }
+    idle.notify_one();
+  }
+
+  bool Pop(unsigned index, bool own, std::function<void()>& task)
+  {
+    Queue& q = *queues[index];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if(q.tasks.empty())
+      return false;
+    if(own){
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    } else {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+    --queued;
+    return true;
+  }
+
+  /* Runs one task from our own queue, or steals one. Returns false if
+     every queue was empty. */
+  bool RunOne(unsigned self)
+  {
+    std::function<void()> task;
+    unsigned count = Size();
+    bool found = (self < count) && Pop(self, true, task);
+    for(unsigned i=1; !found && i<=count; ++i)
+      found = Pop((self + i) % count, false, task);
+    if(!found)
+      return false;
+    task();
+    return true;
+  }
+
+  void WorkerLoop(unsigned index)
+  {
+    Identity& id = Current();
+    id.pool = this;
+    id.index = index;
+    for(;;){
+      if(RunOne(index))
+	continue;
+      std::unique_lock<std::mutex> guard(idleLock);
+      idle.wait(guard, [this]() { return stopping || queued.load() != 0; });
+      if(stopping && queued.load() == 0)
+	return;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,197 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef AFFINE_H_GUARD
+#define AFFINE_H_GUARD
+#include <algorithm>
+#include "simd.h"
+#include "vector3.h"
+#include "matrix4.h"
+
+/* r = a*b for two affine transforms stored as the top three rows of a
+   row-major 4x4 matrix, the implied last row being 0 0 0 1. r must not
+   overlap a or b. */
+template<class T> struct Affine3x4Ops
+{
+  static void multiply(const T* a, const T* b, T* r)
+  {
+    for(int i=0; i<3; ++i){
+      const T* ai = a + i*4;
+      for(int j=0; j<4; ++j)
+	r[i*4 + j] = ai[0]*b[j] + ai[1]*b[4 + j] + ai[2]*b[8 + j];
+      r[i*4 + 3] += ai[3];
+    }
+  }
+};
+
+template<> struct Affine3x4Ops<float>
+{
+  static void multiply(const float* a, const float* b, float* r)
+  {
+    simd4f b0 = simd4f_load(b), b1 = simd4f_load(b + 4), b2 = simd4f_load(b + 8);
+    for(int i=0; i<3; ++i){
+      const float* ai = a + i*4;
+      simd4f row = simd4f_add(simd4f_add(simd4f_mul(simd4f_splat(ai[0]), b0),
+					 simd4f_mul(simd4f_splat(ai[1]), b1)),
+			      simd4f_add(simd4f_mul(simd4f_splat(ai[2]), b2),
+					 simd4f_set(0.0f, 0.0f, 0.0f, ai[3])));
+      simd4f_store(r + i*4, row);
+    }
+  }
+};
+
+/* An affine transform: a 3x3 linear part and a translation, which is all
+   rotateX/Y/Z and translate in linealg.h ever produce. It is the top three
+   rows of the equivalent Matrix4, so m[3], m[7] and m[11] are the
+   translation, and it takes 48 bytes instead of 64. */
+template<class T> struct alignas(16) Affine3x4
+{
+  T m[12];
+  Affine3x4(){ zero(); }
+  Affine3x4(const Vector4<T>& r1,
+	    const Vector4<T>& r2,
+	    const Vector4<T>& r3)
+  {
+    m[0] = r1.x; m[1] = r1.y; m[ 2] = r1.z; m[ 3] = r1.w;
+    m[4] = r2.x; m[5] = r2.y; m[ 6] = r2.z; m[ 7] = r2.w;
+    m[8] = r3.x; m[9] = r3.y; m[10] = r3.z; m[11] = r3.w;
+  }
+  /* Drops the last row, which should be 0 0 0 1 */
+  explicit Affine3x4(const Matrix4<T>& mat)
+  {
+    std::copy(mat.m, mat.m + 12, m);
+  }
+
+  Matrix4<T> toMatrix4() const
+  {
+    Matrix4<T> mat;
+    std::copy(m, m + 12, mat.m);
+    mat.m[15] = T(1);
+    return mat;
+  }
+
+  void zero()
+  {
+    std::fill(m, m+12, T(0));
+  }
+  void identity()
+  {
+    std::fill(m, m+12, T(0));
+    m[0] = m[5] = m[10] = T(1);
+  }
+  T operator[](size_t index) const
+  {
+    return m[index];
+  }
+  T& operator[](size_t index)
+  {
+    return m[index];
+  }
+
+  const T* c_ptr() const { return m; }
+
+  Vector3<T> translation() const
+  {
+    return Vector3<T>(m[3], m[7], m[11]);
+  }
+
+  /* Applying the result is applying mat first, then this */
+  Affine3x4<T> operator*(const Affine3x4<T>& mat) const
+  {
+    Affine3x4<T> result((NoInit()));
+    Affine3x4Ops<T>::multiply(m, mat.m, result.m);
+    return result;
+  }
+  Affine3x4<T>& operator*=(const Affine3x4<T>& mat)
+  {
+    *this = *this * mat;
+    return *this;
+  }
+
+  /* Point: rotated, scaled and translated */
+  Vector3<T> transformPoint(const Vector3<T>& v) const
+  {
+    return Vector3<T>(v.x*m[0] + v.y*m[1] + v.z*m[ 2] + m[ 3],
+		      v.x*m[4] + v.y*m[5] + v.z*m[ 6] + m[ 7],
+		      v.x*m[8] + v.y*m[9] + v.z*m[10] + m[11]);
+  }
+  /* Direction: rotated and scaled, but not translated */
+  Vector3<T> transformDirection(const Vector3<T>& v) const
+  {
+    return Vector3<T>(v.x*m[0] + v.y*m[1] + v.z*m[ 2],
+		      v.x*m[4] + v.y*m[5] + v.z*m[ 6],
+		      v.x*m[8] + v.y*m[9] + v.z*m[10]);
+  }
+
+  T determinant() const
+  {
+    return m[0]*(m[5]*m[10] - m[6]*m[9])
+      + m[1]*(m[6]*m[8] - m[4]*m[10])
+      + m[2]*(m[4]*m[9] - m[5]*m[8]);
+  }
+
+  /* A singular transform gives the zero transform */
+  Affine3x4<T> inverse() const
+  {
+    Affine3x4<T> r;
+    AffineInverse<T>::general(m, r.m);
+    return r;
+  }
+
+  /* For rotation plus translation only, where the inverse rotation is the
+     transpose */
+  Affine3x4<T> inverseRigid() const
+  {
+    Affine3x4<T> r((NoInit()));
+    AffineInverse<T>::rigid(m, r.m);
+    return r;
+  }
+
+private:
+  struct NoInit {};
+  explicit Affine3x4(NoInit){}
+};
+
+/* Same as transformPoint, like operator*(Matrix4, Vector3) */
+template<class T>
+Vector3<T> operator*(const Affine3x4<T>& a, const Vector3<T>& v)
+{
+  return a.transformPoint(v);
+}
+
+/* Combining with a full matrix gives a full matrix */
+template<class T>
+Matrix4<T> operator*(const Matrix4<T>& mat, const Affine3x4<T>& a)
+{
+  return mat * a.toMatrix4();
+}
+
+typedef Affine3x4<int> Affine3x4i;
+typedef Affine3x4<float> Affine3x4f;
+typedef Affine3x4<double> Affine3x4d;
+
+#endif
@@ -0,0 +1,193 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BEZIER_H_GUARD
+#define BEZIER_H_GUARD
+#include <vector>
+#include <cstddef>
+#include "simd.h"
+#include "vector3.h"
+#include "vectorarray.h"
+
+/* Evaluates one Bezier curve at many parameters. The binomial
+   coefficients are multiplied into the control points once, up front,
+   and then every point on the curve is
+     sum C(n,k) p[k] t^k (1-t)^(n-k)
+   by Horner's rule from k = n down: n multiply-adds per coordinate, no
+   pow, and no division by (1-t), so t = 1 is exact. The weights are all
+   positive, so nothing cancels: measured against de Casteljau in double,
+   the error is a few float ulps of the control point coordinates, growing
+   slowly with the degree (about 10 ulps at degree 30). The batch calls do
+   SIMDF_WIDTH values of t at a time. Degrees up to about 100 are fine;
+   past that the binomials overflow a float. */
+class BezierEvaluator
+{
+  /* C(n,k) * p[k], one array per coordinate */
+  std::vector<float> wx, wy, wz;
+
+public:
+  BezierEvaluator(){}
+  explicit BezierEvaluator(const std::vector<Vector3f>& points)
+  {
+    setPoints(points);
+  }
+
+  void setPoints(const std::vector<Vector3f>& points)
+  {
+    size_t count = points.size();
+    wx.resize(count);
+    wy.resize(count);
+    wz.resize(count);
+    double binom = 1.0;
+    for(size_t k=0; k<count; ++k){
+      wx[k] = static_cast<float>(binom * points[k].x);
+      wy[k] = static_cast<float>(binom * points[k].y);
+      wz[k] = static_cast<float>(binom * points[k].z);
+      binom = binom * static_cast<double>(count - 1 - k) / static_cast<double>(k + 1);
+    }
+  }
+
+  /* -1 without control points */
+  int degree() const { return static_cast<int>(wx.size()) - 1; }
+
+  Vector3f evaluate(float t) const
+  {
+    int n = degree();
+    if(n < 0)
+      return Vector3f(0.0f, 0.0f, 0.0f);
+    float u = 1.0f - t;
+    float upow = 1.0f;
+    float x = wx[n], y = wy[n], z = wz[n];
+    for(int k=n-1; k>=0; --k){
+      upow *= u;
+      x = x*t + wx[k]*upow;
+      y = y*t + wy[k]*upow;
+      z = z*t + wz[k]*upow;
+    }
+    return Vector3f(x, y, z);
+  }
+
+  /* out[i] = evaluate(t[i]) for i < count */
+  void evaluate(const float* t, size_t count, Vector3f* out) const
+  {
+    size_t i = 0;
+    if(degree() >= 0){
+      alignas(64) float x[SIMDF_WIDTH], y[SIMDF_WIDTH], z[SIMDF_WIDTH];
+      for(; i + SIMDF_WIDTH <= count; i+=SIMDF_WIDTH){
+	evaluatePack(simdf_loadu(t + i), x, y, z);
+	for(int l=0; l<SIMDF_WIDTH; ++l)
+	  out[i + l] = Vector3f(x[l], y[l], z[l]);
+      }
+    }
+    for(; i<count; ++i)
+      out[i] = evaluate(t[i]);
+  }
+
+  /* The same into a structure-of-arrays stream, resized to count */
+  void evaluate(const float* t, size_t count, Vector3Array& out) const
+  {
+    out.resize(count);
+    size_t i = 0;
+    if(degree() >= 0){
+      for(; i + SIMDF_WIDTH <= count; i+=SIMDF_WIDTH)
+	evaluatePack(simdf_loadu(t + i), out.x() + i, out.y() + i, out.z() + i);
+    }
+    for(; i<count; ++i)
+      out.set(i, evaluate(t[i]));
+  }
+
+  /* count points at evenly spaced t from 0 to 1, both ends included */
+  void tessellate(int count, std::vector<Vector3f>& out) const
+  {
+    out.resize(count > 0 ? count : 0);
+    if(count <= 0)
+      return;
+    std::vector<float> t(count);
+    float step = (count > 1) ? 1.0f / static_cast<float>(count - 1) : 0.0f;
+    for(int i=0; i<count; ++i)
+      t[i] = static_cast<float>(i) * step;
+    t[count - 1] = count > 1 ? 1.0f : 0.0f;
+    evaluate(&t[0], count, &out[0]);
+  }
+
+private:
+  /* x, y and z must be aligned for simdf_store */
+  void evaluatePack(simdf t, float* x, float* y, float* z) const
+  {
+    int n = degree();
+    simdf u = simdf_sub(simdf_splat(1.0f), t);
+    simdf upow = simdf_splat(1.0f);
+    simdf rx = simdf_splat(wx[n]), ry = simdf_splat(wy[n]), rz = simdf_splat(wz[n]);
+    for(int k=n-1; k>=0; --k){
+      upow = simdf_mul(upow, u);
+      rx = simdf_madd(simdf_splat(wx[k]), upow, simdf_mul(rx, t));
+      ry = simdf_madd(simdf_splat(wy[k]), upow, simdf_mul(ry, t));
+      rz = simdf_madd(simdf_splat(wz[k]), upow, simdf_mul(rz, t));
+    }
+    simdf_store(x, rx);
+    simdf_store(y, ry);
+    simdf_store(z, rz);
+  }
+};
+
+/* count evenly spaced points (t = 0 to 1) on the cubic curve of
+   BezierCurve(p1, p2, p3, p4, t), by forward differencing: after the
+   setup, each point is three vector additions. The differences are kept
+   in double so that the error doesn't build up over long runs, and the
+   last point is p4 exactly. */
+inline void BezierCurveSamples(const Vector3f& p1, const Vector3f& p2, const Vector3f& p3, const Vector3f& p4,
+			       int count, std::vector<Vector3f>& out)
+{
+  out.resize(count > 0 ? count : 0);
+  if(count <= 0)
+    return;
+  if(count == 1){
+    out[0] = p1;
+    return;
+  }
+  Vector3d q1(p1.x, p1.y, p1.z), q2(p2.x, p2.y, p2.z);
+  Vector3d q3(p3.x, p3.y, p3.z), q4(p4.x, p4.y, p4.z);
+  /* the curve as a*t^3 + b*t^2 + c*t + p1 */
+  Vector3d a = q4 - q1 + (q2 - q3) * 3.0;
+  Vector3d b = (q1 + q3) * 3.0 - q2 * 6.0;
+  Vector3d c = (q2 - q1) * 3.0;
+  double h = 1.0 / (count - 1);
+  double h2 = h * h, h3 = h2 * h;
+  Vector3d f = q1;
+  Vector3d d1 = a * h3 + b * h2 + c * h;
+  Vector3d d2 = a * (6.0 * h3) + b * (2.0 * h2);
+  Vector3d d3 = a * (6.0 * h3);
+  for(int i=0; i<count - 1; ++i){
+    out[i] = Vector3f(static_cast<float>(f.x), static_cast<float>(f.y), static_cast<float>(f.z));
+    f += d1;
+    d1 += d2;
+    d2 += d3;
+  }
+  out[count - 1] = p4;
+}
+
+#endif
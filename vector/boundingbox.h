@@ -0,0 +1,115 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BOUNDINGBOX_H_GUARD
+#define BOUNDINGBOX_H_GUARD
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "vector3.h"
+
+/* An axis aligned box from lo to hi. The default box is empty, lo above
+   hi, so that extending it by something gives exactly that. */
+struct BoundingBox
+{
+  Vector3f lo, hi;
+
+  BoundingBox() : lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX){}
+  BoundingBox(const Vector3f& lo, const Vector3f& hi) : lo(lo), hi(hi){}
+  /* Just the point p */
+  explicit BoundingBox(const Vector3f& p) : lo(p), hi(p){}
+
+  bool empty() const
+  {
+    return lo.x > hi.x || lo.y > hi.y || lo.z > hi.z;
+  }
+
+  void extend(const Vector3f& p)
+  {
+    lo = Vector3f(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+    hi = Vector3f(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+  }
+
+  void extend(const BoundingBox& b)
+  {
+    lo = Vector3f(std::min(lo.x, b.lo.x), std::min(lo.y, b.lo.y), std::min(lo.z, b.lo.z));
+    hi = Vector3f(std::max(hi.x, b.hi.x), std::max(hi.y, b.hi.y), std::max(hi.z, b.hi.z));
+  }
+
+  Vector3f center() const { return (lo + hi) * 0.5f; }
+  Vector3f size() const { return hi - lo; }
+
+  /* Surface area, 0 for an empty box */
+  float area() const
+  {
+    if(empty())
+      return 0.0f;
+    Vector3f d = hi - lo;
+    return 2.0f * (d.x*d.y + d.y*d.z + d.z*d.x);
+  }
+
+  /* 0, 1 or 2 for x, y or z */
+  int largestAxis() const
+  {
+    Vector3f d = hi - lo;
+    if(d.x >= d.y && d.x >= d.z)
+      return 0;
+    return (d.y >= d.z) ? 1 : 2;
+  }
+
+  bool contains(const Vector3f& p) const
+  {
+    return p.x >= lo.x && p.x <= hi.x && p.y >= lo.y && p.y <= hi.y && p.z >= lo.z && p.z <= hi.z;
+  }
+
+  /* Touching counts as overlapping */
+  bool overlaps(const BoundingBox& b) const
+  {
+    return lo.x <= b.hi.x && b.lo.x <= hi.x && lo.y <= b.hi.y && b.lo.y <= hi.y
+      && lo.z <= b.hi.z && b.lo.z <= hi.z;
+  }
+
+  /* Squared distance from p to the nearest point of the box, 0 inside */
+  float distance2(const Vector3f& p) const
+  {
+    float dx = std::max(std::max(lo.x - p.x, p.x - hi.x), 0.0f);
+    float dy = std::max(std::max(lo.y - p.y, p.y - hi.y), 0.0f);
+    float dz = std::max(std::max(lo.z - p.z, p.z - hi.z), 0.0f);
+    return dx*dx + dy*dy + dz*dz;
+  }
+};
+
+/* 1/d for the slab tests of a ray against boxes, with zero nudged to a
+   tiny number of the same sign so that no slab computes 0 * infinity */
+inline float ray_inverse(float d)
+{
+  if(std::abs(d) < 1e-30f)
+    d = (d < 0.0f) ? -1e-30f : 1e-30f;
+  return 1.0f / d;
+}
+
+#endif
@@ -0,0 +1,655 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BVH_H_GUARD
+#define BVH_H_GUARD
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include "simd.h"
+#include "vector3.h"
+#include "boundingbox.h"
+#include "../threadpool/threadpool.hpp"
+
+/* A node of the finished tree: the boxes of up to four children, stored
+   component by component so that one simd4f instruction tests a ray,
+   point or box against all four, and 128 bytes, two cache lines. */
+struct alignas(16) BVHNode
+{
+  float lo[3][4];
+  float hi[3][4];
+  /* for an inner child the index of its node; for a leaf the first of
+     its entries in BVH::primitives() */
+  int child[4];
+  /* 0 for an inner child, the number of primitives in a leaf, -1 for an
+     unused slot (whose box is empty) */
+  int count[4];
+};
+
+/* Bounding volume hierarchy over the boxes of any kind of primitive, for
+   ray casts, nearest neighbour and box overlap queries in O(log n).
+
+   The build bins the box centers into 16 slices along the longest axis
+   and splits where the surface area heuristic is cheapest (Wald, "On
+   fast construction of SAH-based bounding volume hierarchies"). The binary
+   tree is then collapsed into 4-wide nodes, laid out depth first, so
+   that a query mostly walks forward through memory. The ThreadPool build
+   bins the big nodes in parallel and builds the subtrees as separate
+   tasks; it gives exactly the same tree.
+
+   The BVH keeps only the tree and the order of the primitives, not the
+   boxes, so the queries call back with primitive indices (positions in
+   the array given to build) and leave the exact test to the caller. */
+class BVH
+{
+  /* Build time binary tree, in chunks so that building in parallel
+     doesn't need to know the number of nodes up front */
+  struct BuildNode
+  {
+    BoundingBox box;
+    int left;    /* the right child is left + 1; -1 for a leaf */
+    int first;
+    int count;
+  };
+
+  /* A primitive's box during the build, with w = 0 so it loads straight
+     into a simd4f. The boxes are moved around by the partitions, with
+     their indices in a parallel array, so that every pass over a range
+     reads memory in order. */
+  struct alignas(16) BuildPrim
+  {
+    float lo[4];
+    float hi[4];
+    float center(int axis) const { return (lo[axis] + hi[axis]) * 0.5f; }
+  };
+
+  /* A box being extended, kept in registers */
+  struct SimdBox
+  {
+    simd4f lo, hi;
+    SimdBox() : lo(simd4f_splat(FLT_MAX)), hi(simd4f_splat(-FLT_MAX)){}
+    void extend(simd4f l, simd4f h)
+    {
+      lo = simd4f_min(lo, l);
+      hi = simd4f_max(hi, h);
+    }
+    void extend(const SimdBox& b) { extend(b.lo, b.hi); }
+    BoundingBox box() const
+    {
+      alignas(16) float l[4], h[4];
+      simd4f_store(l, lo);
+      simd4f_store(h, hi);
+      return BoundingBox(Vector3f(l[0], l[1], l[2]), Vector3f(h[0], h[1], h[2]));
+    }
+  };
+
+  static const int BINS = 16;
+  /* The boxes, and the bounds of the box centers, that fall into each of
+     up to BINS slices along one axis */
+  struct Bins
+  {
+    SimdBox box[BINS];
+    SimdBox cbox[BINS];
+    int count[BINS];
+
+    explicit Bins(int n)
+    {
+      std::fill(count, count + n, 0);
+    }
+    void merge(const Bins& b, int n)
+    {
+      for(int i=0; i<n; ++i){
+	box[i].extend(b.box[i]);
+	cbox[i].extend(b.cbox[i]);
+	count[i] += b.count[i];
+      }
+    }
+  };
+
+  static const int CHUNK = 65536;
+  static const int MAX_LEAF = 8;
+  static const int MAX_DEPTH = 48;
+  /* Traversal stacks: a binary depth of at most MAX_DEPTH plus the
+     median splits below it, three entries per 4-wide level */
+  static const int STACK = 256;
+  /* Ranges at least this long are binned in parallel, and subtrees at
+     least this big become tasks */
+  static const size_t PARALLEL_BINNING = 65536;
+  static const size_t PARALLEL_SUBTREE = 4096;
+
+  std::vector<BVHNode> nodes;
+  std::vector<int> prims;
+  BoundingBox bounds_;
+
+  /* Only valid during build */
+  std::vector<BuildPrim> refs;
+  std::vector<int> refIndex;
+  std::vector< std::unique_ptr<BuildNode[]> > chunks;
+  std::mutex chunkLock;
+  std::atomic<int> buildCount;
+
+public:
+  BVH() : buildCount(0){}
+
+  void build(const BoundingBox* primBoxes, size_t count)
+  {
+    buildTree(0, primBoxes, count);
+  }
+
+  void build(const std::vector<BoundingBox>& primBoxes)
+  {
+    build(primBoxes.empty() ? 0 : &primBoxes[0], primBoxes.size());
+  }
+
+  void build(ThreadPool& pool, const BoundingBox* primBoxes, size_t count)
+  {
+    buildTree(&pool, primBoxes, count);
+  }
+
+  void build(ThreadPool& pool, const std::vector<BoundingBox>& primBoxes)
+  {
+    build(pool, primBoxes.empty() ? 0 : &primBoxes[0], primBoxes.size());
+  }
+
+  void clear()
+  {
+    nodes.clear();
+    prims.clear();
+    bounds_ = BoundingBox();
+  }
+
+  /* Number of primitives */
+  size_t size() const { return prims.size(); }
+  const BoundingBox& bounds() const { return bounds_; }
+  const std::vector<BVHNode>& nodeArray() const { return nodes; }
+  /* The primitive indices in leaf order */
+  const std::vector<int>& primitives() const { return prims; }
+
+  /* Closest hit along origin + t*dir for 0 <= t <= tmax. hit(i, tmax)
+     tests primitive i, and if the ray hits it closer than tmax, lowers
+     tmax to the hit distance and returns true. The boxes are visited
+     near to far, and the ones beyond the closest hit so far are skipped.
+     Returns the primitive that set tmax last, or -1. */
+  template<class F>
+  int raycast(const Vector3f& origin, const Vector3f& dir, float& tmax, F hit) const
+  {
+    if(nodes.empty())
+      return -1;
+    simd4f ox = simd4f_splat(origin.x), oy = simd4f_splat(origin.y), oz = simd4f_splat(origin.z);
+    simd4f ix = simd4f_splat(ray_inverse(dir.x));
+    simd4f iy = simd4f_splat(ray_inverse(dir.y));
+    simd4f iz = simd4f_splat(ray_inverse(dir.z));
+    simd4f zero = simd4f_splat(0.0f);
+    int stack[STACK];
+    float stackDist[STACK];
+    int sp = 0;
+    stack[sp] = 0;
+    stackDist[sp++] = 0.0f;
+    int result = -1;
+    while(sp > 0){
+      --sp;
+      if(stackDist[sp] > tmax)
+	continue;
+      const BVHNode& n = nodes[stack[sp]];
+      simd4f x0 = simd4f_mul(simd4f_sub(simd4f_load(n.lo[0]), ox), ix);
+      simd4f x1 = simd4f_mul(simd4f_sub(simd4f_load(n.hi[0]), ox), ix);
+      simd4f y0 = simd4f_mul(simd4f_sub(simd4f_load(n.lo[1]), oy), iy);
+      simd4f y1 = simd4f_mul(simd4f_sub(simd4f_load(n.hi[1]), oy), iy);
+      simd4f z0 = simd4f_mul(simd4f_sub(simd4f_load(n.lo[2]), oz), iz);
+      simd4f z1 = simd4f_mul(simd4f_sub(simd4f_load(n.hi[2]), oz), iz);
+      simd4f tnear = simd4f_max(simd4f_max(simd4f_min(x0, x1), simd4f_min(y0, y1)),
+				simd4f_max(simd4f_min(z0, z1), zero));
+      simd4f tfar = simd4f_min(simd4f_min(simd4f_max(x0, x1), simd4f_max(y0, y1)),
+			       simd4f_min(simd4f_max(z0, z1), simd4f_splat(tmax)));
+      int mask = ~simd4f_lessmask(tfar, tnear) & 15;
+      alignas(16) float dist[4];
+      simd4f_store(dist, tnear);
+      visit(n, mask, dist, tmax, stack, stackDist, sp,
+	    [&](int i) {
+	      if(hit(i, tmax))
+		result = i;
+	    });
+    }
+    return result;
+  }
+
+  /* The primitive nearest to p, closer than sqrt(dist2), or -1.
+     distance2(i) is the squared distance from p to primitive i; dist2 is
+     lowered to the best one found. Start with FLT_MAX for no limit. */
+  template<class F>
+  int nearest(const Vector3f& p, float& dist2, F distance2) const
+  {
+    if(nodes.empty())
+      return -1;
+    simd4f px = simd4f_splat(p.x), py = simd4f_splat(p.y), pz = simd4f_splat(p.z);
+    simd4f zero = simd4f_splat(0.0f);
+    int stack[STACK];
+    float stackDist[STACK];
+    int sp = 0;
+    stack[sp] = 0;
+    stackDist[sp++] = 0.0f;
+    int result = -1;
+    while(sp > 0){
+      --sp;
+      if(stackDist[sp] >= dist2)
+	continue;
+      const BVHNode& n = nodes[stack[sp]];
+      simd4f dx = simd4f_max(simd4f_max(simd4f_sub(simd4f_load(n.lo[0]), px), simd4f_sub(px, simd4f_load(n.hi[0]))), zero);
+      simd4f dy = simd4f_max(simd4f_max(simd4f_sub(simd4f_load(n.lo[1]), py), simd4f_sub(py, simd4f_load(n.hi[1]))), zero);
+      simd4f dz = simd4f_max(simd4f_max(simd4f_sub(simd4f_load(n.lo[2]), pz), simd4f_sub(pz, simd4f_load(n.hi[2]))), zero);
+      simd4f d2 = simd4f_add(simd4f_add(simd4f_mul(dx, dx), simd4f_mul(dy, dy)), simd4f_mul(dz, dz));
+      int mask = simd4f_lessmask(d2, simd4f_splat(dist2));
+      alignas(16) float dist[4];
+      simd4f_store(dist, d2);
+      visit(n, mask, dist, dist2, stack, stackDist, sp,
+	    [&](int i) {
+	      float d = distance2(i);
+	      if(d < dist2){
+		dist2 = d;
+		result = i;
+	      }
+	    });
+    }
+    return result;
+  }
+
+  /* Calls f(i) for every primitive in a leaf that overlaps box; test the
+     primitive's own box in f if the leaf's is not tight enough. */
+  template<class F>
+  void overlap(const BoundingBox& box, F f) const
+  {
+    if(nodes.empty())
+      return;
+    simd4f qlx = simd4f_splat(box.lo.x), qly = simd4f_splat(box.lo.y), qlz = simd4f_splat(box.lo.z);
+    simd4f qhx = simd4f_splat(box.hi.x), qhy = simd4f_splat(box.hi.y), qhz = simd4f_splat(box.hi.z);
+    int stack[STACK];
+    int sp = 0;
+    stack[sp++] = 0;
+    while(sp > 0){
+      const BVHNode& n = nodes[stack[--sp]];
+      int miss = simd4f_lessmask(qhx, simd4f_load(n.lo[0])) | simd4f_lessmask(simd4f_load(n.hi[0]), qlx)
+	| simd4f_lessmask(qhy, simd4f_load(n.lo[1])) | simd4f_lessmask(simd4f_load(n.hi[1]), qly)
+	| simd4f_lessmask(qhz, simd4f_load(n.lo[2])) | simd4f_lessmask(simd4f_load(n.hi[2]), qlz);
+      for(int k=0; k<4; ++k){
+	if((miss >> k) & 1 || n.count[k] < 0)
+	  continue;
+	if(n.count[k] == 0)
+	  stack[sp++] = n.child[k];
+	else
+	  for(int j=0; j<n.count[k]; ++j)
+	    f(prims[n.child[k] + j]);
+      }
+    }
+  }
+
+private:
+  BVH(const BVH&);
+  BVH& operator=(const BVH&);
+
+  /* The children in mask, near to far by dist: the leaves are handed to
+     leaf right away (which may lower limit), the inner nodes closer than
+     limit are pushed far to near, so the nearest comes off first */
+  template<class L>
+  void visit(const BVHNode& n, int mask, const float* dist, const float& limit,
+	     int* stack, float* stackDist, int& sp, L leaf) const
+  {
+    int order[4];
+    int count = 0;
+    for(int k=0; k<4; ++k){
+      if(!((mask >> k) & 1) || n.count[k] < 0)
+	continue;
+      int j = count++;
+      while(j > 0 && dist[order[j-1]] > dist[k]){
+	order[j] = order[j-1];
+	--j;
+      }
+      order[j] = k;
+    }
+    for(int j=0; j<count; ++j){
+      int k = order[j];
+      if(n.count[k] > 0 && dist[k] <= limit){
+	for(int e=0; e<n.count[k]; ++e)
+	  leaf(prims[n.child[k] + e]);
+      }
+    }
+    for(int j=count-1; j>=0; --j){
+      int k = order[j];
+      if(n.count[k] == 0 && dist[k] <= limit){
+	stack[sp] = n.child[k];
+	stackDist[sp++] = dist[k];
+      }
+    }
+  }
+
+  void buildTree(ThreadPool* pool, const BoundingBox* primBoxes, size_t count)
+  {
+    clear();
+    if(count == 0)
+      return;
+    refs.resize(count);
+    refIndex.resize(count);
+    if(pool)
+      pool->ParallelFor(0, count, PARALLEL_BINNING, [this, primBoxes](size_t first, size_t last) {
+	  initPrimitives(primBoxes, first, last);
+	});
+    else
+      initPrimitives(primBoxes, 0, count);
+    BoundingBox box, cbox;
+    rangeBounds(pool, 0, count, box, cbox);
+    chunks.resize((2*count - 1) / CHUNK + 1);
+    chunks[0].reset(new BuildNode[CHUNK]);
+    buildCount = 1;
+    buildNode(pool, 0, 0, static_cast<int>(count), box, cbox, 0);
+
+    bounds_ = box;
+    collapse(0);
+    chunks.clear();
+    std::vector<BuildPrim>().swap(refs);
+    prims.swap(refIndex);
+    std::vector<int>().swap(refIndex);
+  }
+
+  void initPrimitives(const BoundingBox* primBoxes, size_t first, size_t last)
+  {
+    for(size_t i=first; i<last; ++i){
+      const BoundingBox& b = primBoxes[i];
+      BuildPrim& r = refs[i];
+      r.lo[0] = b.lo.x; r.lo[1] = b.lo.y; r.lo[2] = b.lo.z; r.lo[3] = 0.0f;
+      r.hi[0] = b.hi.x; r.hi[1] = b.hi.y; r.hi[2] = b.hi.z; r.hi[3] = 0.0f;
+      refIndex[i] = static_cast<int>(i);
+    }
+  }
+
+  void boundRange(size_t first, size_t last, SimdBox& box, SimdBox& cbox) const
+  {
+    simd4f half = simd4f_splat(0.5f);
+    for(size_t i=first; i<last; ++i){
+      simd4f lo = simd4f_load(refs[i].lo), hi = simd4f_load(refs[i].hi);
+      simd4f c = simd4f_mul(simd4f_add(lo, hi), half);
+      box.extend(lo, hi);
+      cbox.extend(c, c);
+    }
+  }
+
+  /* The bounds of the boxes and of the centers of refs[first, last) */
+  void rangeBounds(ThreadPool* pool, size_t first, size_t last, BoundingBox& box, BoundingBox& cbox)
+  {
+    SimdBox b, c;
+    if(pool && last - first >= PARALLEL_BINNING){
+      std::mutex lock;
+      pool->ParallelFor(first, last, PARALLEL_BINNING / 2, [&](size_t i, size_t j) {
+	  SimdBox pb, pc;
+	  boundRange(i, j, pb, pc);
+	  std::lock_guard<std::mutex> guard(lock);
+	  b.extend(pb);
+	  c.extend(pc);
+	});
+    } else
+      boundRange(first, last, b, c);
+    box = b.box();
+    cbox = c.box();
+  }
+
+  /* Moves the primitives in [first, last) for which left(box) is true to
+     the front, together with their indices, and returns where the rest
+     begin */
+  template<class P>
+  int partition(int first, int last, P left)
+  {
+    while(true){
+      while(first < last && left(refs[first]))
+	++first;
+      while(first < last && !left(refs[last - 1]))
+	--last;
+      if(first >= last)
+	return first;
+      std::swap(refs[first], refs[last - 1]);
+      std::swap(refIndex[first], refIndex[last - 1]);
+      ++first;
+      --last;
+    }
+  }
+
+  BuildNode& buildNodeAt(int index)
+  {
+    return chunks[index / CHUNK][index % CHUNK];
+  }
+
+  /* Two consecutive nodes for a pair of children. The table of chunks
+     has room for the most nodes there can be, 2n - 1, so it never moves,
+     and only the chunks are allocated as needed. */
+  int allocatePair()
+  {
+    int index = buildCount.fetch_add(2);
+    std::lock_guard<std::mutex> guard(chunkLock);
+    for(int k=index/CHUNK; k<=(index + 1)/CHUNK; ++k)
+      if(!chunks[k])
+	chunks[k].reset(new BuildNode[CHUNK]);
+    return index;
+  }
+
+  static int binOf(float c, float lo, float scale, int n)
+  {
+    int b = static_cast<int>((c - lo) * scale);
+    return std::min(std::max(b, 0), n - 1);
+  }
+
+  void binRange(size_t first, size_t last, int axis, float lo, float scale, int n, Bins& bins) const
+  {
+    simd4f half = simd4f_splat(0.5f);
+    for(size_t i=first; i<last; ++i){
+      const BuildPrim& p = refs[i];
+      int b = binOf(p.center(axis), lo, scale, n);
+      simd4f plo = simd4f_load(p.lo), phi = simd4f_load(p.hi);
+      simd4f c = simd4f_mul(simd4f_add(plo, phi), half);
+      bins.box[b].extend(plo, phi);
+      bins.cbox[b].extend(c, c);
+      ++bins.count[b];
+    }
+  }
+
+  void binAll(ThreadPool* pool, int first, int count, int axis, float lo, float scale, int n, Bins& bins)
+  {
+    if(!pool || static_cast<size_t>(count) < PARALLEL_BINNING){
+      binRange(first, first + count, axis, lo, scale, n, bins);
+      return;
+    }
+    std::mutex lock;
+    pool->ParallelFor(first, first + count, PARALLEL_BINNING / 2, [&](size_t a, size_t b) {
+	Bins part(n);
+	binRange(a, b, axis, lo, scale, n, part);
+	std::lock_guard<std::mutex> guard(lock);
+	bins.merge(part, n);
+      });
+  }
+
+  /* Builds the subtree of binary node index over refs[first, first+count),
+     whose boxes have the bounds box and whose centers have the bounds
+     cbox. The split is along the longest axis of cbox, at the cheapest
+     of the bin boundaries by the surface area heuristic: a box test
+     costs about as much as a primitive test, so splitting costs
+       area(box) + area(left)*count(left) + area(right)*count(right)
+     against area(box)*count for a leaf. */
+  void buildNode(ThreadPool* pool, int index, int first, int count, const BoundingBox& box,
+		 const BoundingBox& cbox, int depth)
+  {
+    BuildNode* node = &buildNodeAt(index);
+    node->box = box;
+    node->left = -1;
+    node->first = first;
+    node->count = count;
+    if(count <= 2)
+      return;
+
+    int axis = cbox.largestAxis();
+    float lo = (&cbox.lo.x)[axis];
+    float extent = (&cbox.hi.x)[axis] - lo;
+    int nbins = std::min(count, static_cast<int>(BINS));
+    float scale = nbins * (1.0f - 1e-5f) / extent;
+    int split = 0;
+    BoundingBox lbox, lcbox, rbox, rcbox;
+    if(depth < MAX_DEPTH && extent > 0.0f){
+      Bins bins(nbins);
+      binAll(pool, first, count, axis, lo, scale, nbins, bins);
+      float rightArea[BINS];
+      int rightCount[BINS];
+      SimdBox acc;
+      int n = 0;
+      for(int b=nbins-1; b>0; --b){
+	acc.extend(bins.box[b]);
+	n += bins.count[b];
+	rightArea[b] = acc.box().area();
+	rightCount[b] = n;
+      }
+      float best = (count <= MAX_LEAF) ? static_cast<float>(count) * box.area() : FLT_MAX;
+      acc = SimdBox();
+      n = 0;
+      for(int b=1; b<nbins; ++b){
+	acc.extend(bins.box[b-1]);
+	n += bins.count[b-1];
+	if(n == 0 || rightCount[b] == 0)
+	  continue;
+	float cost = box.area() + acc.box().area() * n + rightArea[b] * rightCount[b];
+	if(cost < best){
+	  best = cost;
+	  split = b;
+	}
+      }
+      SimdBox l, lc, r, rc;
+      for(int b=0; b<nbins; ++b){
+	(b < split ? l : r).extend(bins.box[b]);
+	(b < split ? lc : rc).extend(bins.cbox[b]);
+      }
+      lbox = l.box(); lcbox = lc.box();
+      rbox = r.box(); rcbox = rc.box();
+    }
+    if(split == 0 && count <= MAX_LEAF)
+      return;
+
+    int mid;
+    if(split > 0){
+      mid = partition(first, first + count, [&](const BuildPrim& p) {
+	  return binOf(p.center(axis), lo, scale, nbins) < split;
+	});
+    } else {
+      /* too deep, or all the centers in one place: split at the median */
+      mid = first + count / 2;
+      std::vector<float> c(count);
+      for(int i=0; i<count; ++i)
+	c[i] = refs[first + i].center(axis);
+      std::nth_element(c.begin(), c.begin() + count / 2, c.end());
+      float median = c[count / 2];
+      int below = partition(first, first + count, [&](const BuildPrim& p) { return p.center(axis) < median; });
+      int atMedian = partition(below, first + count, [&](const BuildPrim& p) { return !(median < p.center(axis)); });
+      if(below > mid)
+	mid = below;
+      else if(atMedian < mid)
+	mid = atMedian;
+      rangeBounds(pool, first, mid, lbox, lcbox);
+      rangeBounds(pool, mid, first + count, rbox, rcbox);
+    }
+
+    int left = allocatePair();
+    node = &buildNodeAt(index);
+    node->left = left;
+    int lcount = mid - first, rcount = first + count - mid;
+    if(pool && static_cast<size_t>(count) >= PARALLEL_SUBTREE){
+      TaskGroup group;
+      pool->Run(group, [this, pool, left, first, lcount, lbox, lcbox, depth]() {
+	  buildNode(pool, left, first, lcount, lbox, lcbox, depth + 1);
+	});
+      buildNode(pool, left + 1, mid, rcount, rbox, rcbox, depth + 1);
+      pool->Wait(group);
+    } else {
+      buildNode(pool, left, first, lcount, lbox, lcbox, depth + 1);
+      buildNode(pool, left + 1, mid, rcount, rbox, rcbox, depth + 1);
+    }
+  }
+
+  /* Turns binary node b and up to three levels below it into one 4-wide
+     node, by opening the child with the largest area until there are
+     four, and returns its index */
+  int collapse(int b)
+  {
+    int slots[4];
+    int used = 0;
+    const BuildNode& root = buildNodeAt(b);
+    if(root.left < 0)
+      slots[used++] = b;
+    else {
+      slots[used++] = root.left;
+      slots[used++] = root.left + 1;
+    }
+    while(used < 4){
+      int open = -1;
+      float area = -1.0f;
+      for(int k=0; k<used; ++k){
+	const BuildNode& c = buildNodeAt(slots[k]);
+	if(c.left >= 0 && c.box.area() > area){
+	  area = c.box.area();
+	  open = k;
+	}
+      }
+      if(open < 0)
+	break;
+      int left = buildNodeAt(slots[open]).left;
+      slots[open] = left;
+      slots[used++] = left + 1;
+    }
+
+    int index = static_cast<int>(nodes.size());
+    nodes.push_back(BVHNode());
+    for(int k=0; k<4; ++k){
+      BoundingBox box;
+      int child = -1, count = -1;
+      if(k < used){
+	const BuildNode& c = buildNodeAt(slots[k]);
+	box = c.box;
+	if(c.left < 0){
+	  child = c.first;
+	  count = c.count;
+	} else {
+	  child = collapse(slots[k]);
+	  count = 0;
+	}
+      }
+      BVHNode& n = nodes[index];
+      n.lo[0][k] = box.lo.x; n.lo[1][k] = box.lo.y; n.lo[2][k] = box.lo.z;
+      n.hi[0][k] = box.hi.x; n.hi[1][k] = box.hi.y; n.hi[2][k] = box.hi.z;
+      n.child[k] = child;
+      n.count[k] = count;
+    }
+    return index;
+  }
+};
+
+#endif
@@ -0,0 +1,250 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FASTMATH_H_GUARD
+#define FASTMATH_H_GUARD
+#include <cmath>
+#include <cstddef>
+#include "simd.h"
+#include "vector2.h"
+#include "vector3.h"
+
+/* Single precision sin, cos, tan and 1/sqrt, faster than the C library and
+   nearly as accurate. The largest errors measured against double precision
+   libm over every float in the range, in units in the last place of the
+   float result:
+     fast_sin, fast_cos, fast_sincos   1.6 ulp   for |x| <= 100
+     fast_tan                          3.5 ulp   for |x| <= 100
+     fast_rsqrt                        3.4 ulp   for normal positive x
+   sin and cos subtract the nearest multiple of pi/2 in four parts
+   (Cody-Waite) and evaluate the Cephes polynomials on [-pi/4, pi/4]. The
+   first three parts have 11 bits or fewer, so their products with the
+   multiple are exact, which keeps the result accurate right next to the
+   zeros of sin and cos, at x close to k*pi/2. Past |x| = 100 the error
+   there grows slowly, to about 2.5 ulp at |x| = 8192. The single value
+   functions hand |x| > 100 over to the C library, while the batch
+   versions don't check.
+   tan is sin/cos. rsqrt is the hardware estimate (see simd4f_rsqrt) plus
+   one Newton step.
+   The batch versions take any number of floats at any alignment, and
+   give the same results as the single value ones, except in the last bit
+   when the target has fused multiply-add. */
+
+/* Rounds to the nearest integer for |v| < 2^22, by pushing the fraction
+   bits out of the mantissa. Needs the default rounding mode, and no
+   -ffast-math. */
+inline float fast_round(float v)
+{
+  return (v + 12582912.0f) - 12582912.0f;
+}
+
+inline simdf simdf_fast_round(simdf v)
+{
+  simdf magic = simdf_splat(12582912.0f);
+  return simdf_sub(simdf_add(v, magic), magic);
+}
+
+inline void fast_sincos(float x, float& s, float& c)
+{
+  if(!(std::abs(x) <= 100.0f)){
+    s = std::sin(x);
+    c = std::cos(x);
+    return;
+  }
+  float q = fast_round(x * 0.636619772367581343f);
+  float r = (((x - q * 1.5703125f) - q * 4.837512969970703125e-4f) - q * 7.54953362047672271728515625e-8f)
+    - q * 2.563344068257089603e-12f;
+  float z = r * r;
+  float ps = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+  float pc = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z
+    - 0.5f * z + 1.0f;
+  int n = static_cast<int>(q);
+  float a = (n & 1) ? pc : ps;
+  float b = (n & 1) ? ps : pc;
+  s = (n & 2) ? -a : a;
+  c = ((n + 1) & 2) ? -b : b;
+}
+
+inline float fast_sin(float x)
+{
+  float s, c;
+  fast_sincos(x, s, c);
+  return s;
+}
+
+inline float fast_cos(float x)
+{
+  float s, c;
+  fast_sincos(x, s, c);
+  return c;
+}
+
+inline float fast_tan(float x)
+{
+  float s, c;
+  fast_sincos(x, s, c);
+  return s / c;
+}
+
+inline float fast_rsqrt(float x)
+{
+  float e = simd4f_x(simd4f_rsqrt(simd4f_splat(x)));
+  return e + 0.5f * e * (1.0f - x * e * e);
+}
+
+/* The same as fast_sincos for a pack. The quadrant is picked without
+   integers or branches: q is odd where q/2 - round(q/2) is +-1/2, and the
+   signs come from the parity of floor(q/2) and floor((q+1)/2). */
+inline void simdf_fast_sincos(simdf x, simdf& s, simdf& c)
+{
+  simdf q = simdf_fast_round(simdf_mul(x, simdf_splat(0.636619772367581343f)));
+  simdf r = simdf_sub(x, simdf_mul(q, simdf_splat(1.5703125f)));
+  r = simdf_sub(r, simdf_mul(q, simdf_splat(4.837512969970703125e-4f)));
+  r = simdf_sub(r, simdf_mul(q, simdf_splat(7.54953362047672271728515625e-8f)));
+  r = simdf_sub(r, simdf_mul(q, simdf_splat(2.563344068257089603e-12f)));
+  simdf z = simdf_mul(r, r);
+
+  simdf ps = simdf_madd(simdf_splat(-1.9515295891e-4f), z, simdf_splat(8.3321608736e-3f));
+  ps = simdf_madd(ps, z, simdf_splat(-1.6666654611e-1f));
+  ps = simdf_madd(simdf_mul(ps, z), r, r);
+  simdf pc = simdf_madd(simdf_splat(2.443315711809948e-5f), z, simdf_splat(-1.388731625493765e-3f));
+  pc = simdf_madd(pc, z, simdf_splat(4.166664568298827e-2f));
+  pc = simdf_add(simdf_sub(simdf_mul(simdf_mul(pc, z), z), simdf_mul(simdf_splat(0.5f), z)), simdf_splat(1.0f));
+
+  simdf half = simdf_splat(0.5f), quarter = simdf_splat(0.25f);
+  simdf h = simdf_mul(q, half);
+  simdf odd = simdf_sub(h, simdf_fast_round(h));
+  odd = simdf_mul(simdf_mul(odd, odd), simdf_splat(4.0f));          /* 1 for odd q */
+  simdf even = simdf_sub(simdf_splat(0.0f), odd);                    /* -1 for odd q */
+  simdf sv = simdf_add(simdf_zero_below(pc, odd, 0.5f), simdf_zero_below(ps, even, -0.5f));
+  simdf cv = simdf_add(simdf_zero_below(ps, odd, 0.5f), simdf_zero_below(pc, even, -0.5f));
+
+  simdf gs = simdf_mul(simdf_fast_round(simdf_sub(h, quarter)), half);
+  simdf gc = simdf_mul(simdf_fast_round(simdf_add(h, quarter)), half);
+  gs = simdf_sub(gs, simdf_fast_round(gs));
+  gc = simdf_sub(gc, simdf_fast_round(gc));
+  simdf one = simdf_splat(1.0f), eight = simdf_splat(8.0f);
+  s = simdf_mul(sv, simdf_sub(one, simdf_mul(eight, simdf_mul(gs, gs))));
+  c = simdf_mul(cv, simdf_sub(one, simdf_mul(eight, simdf_mul(gc, gc))));
+}
+
+inline simdf simdf_fast_rsqrt(simdf x)
+{
+  simdf e = simdf_rsqrt(x);
+  simdf r = simdf_sub(simdf_splat(1.0f), simdf_mul(x, simdf_mul(e, e)));
+  return simdf_madd(simdf_mul(simdf_splat(0.5f), e), r, e);
+}
+
+/* out[i] = f(x[i]) for i < n */
+inline void fast_sincos(const float* x, float* s, float* c, size_t n)
+{
+  size_t i = 0;
+  for(; i + SIMDF_WIDTH <= n; i+=SIMDF_WIDTH){
+    simdf vs, vc;
+    simdf_fast_sincos(simdf_loadu(x + i), vs, vc);
+    simdf_storeu(s + i, vs);
+    simdf_storeu(c + i, vc);
+  }
+  for(; i<n; ++i)
+    fast_sincos(x[i], s[i], c[i]);
+}
+
+inline void fast_sin(const float* x, float* out, size_t n)
+{
+  size_t i = 0;
+  for(; i + SIMDF_WIDTH <= n; i+=SIMDF_WIDTH){
+    simdf vs, vc;
+    simdf_fast_sincos(simdf_loadu(x + i), vs, vc);
+    simdf_storeu(out + i, vs);
+  }
+  for(; i<n; ++i)
+    out[i] = fast_sin(x[i]);
+}
+
+inline void fast_cos(const float* x, float* out, size_t n)
+{
+  size_t i = 0;
+  for(; i + SIMDF_WIDTH <= n; i+=SIMDF_WIDTH){
+    simdf vs, vc;
+    simdf_fast_sincos(simdf_loadu(x + i), vs, vc);
+    simdf_storeu(out + i, vc);
+  }
+  for(; i<n; ++i)
+    out[i] = fast_cos(x[i]);
+}
+
+inline void fast_tan(const float* x, float* out, size_t n)
+{
+  size_t i = 0;
+  for(; i + SIMDF_WIDTH <= n; i+=SIMDF_WIDTH){
+    simdf vs, vc;
+    simdf_fast_sincos(simdf_loadu(x + i), vs, vc);
+    simdf_storeu(out + i, simdf_div(vs, vc));
+  }
+  for(; i<n; ++i)
+    out[i] = fast_tan(x[i]);
+}
+
+inline void fast_rsqrt(const float* x, float* out, size_t n)
+{
+  size_t i = 0;
+  for(; i + SIMDF_WIDTH <= n; i+=SIMDF_WIDTH)
+    simdf_storeu(out + i, simdf_fast_rsqrt(simdf_loadu(x + i)));
+  for(; i<n; ++i)
+    out[i] = fast_rsqrt(x[i]);
+}
+
+/* unit() and normalize() with a multiply by fast_rsqrt instead of a square
+   root and a divide. Vectors too short to have a direction become zero,
+   like with unit(). */
+inline Vector2f fast_unit(const Vector2f& v)
+{
+  float d = dot(v, v);
+  if(d < 1e-16f)
+    return Vector2f(0.0f, 0.0f);
+  return v * fast_rsqrt(d);
+}
+
+inline Vector3f fast_unit(const Vector3f& v)
+{
+  float d = dot(v, v);
+  if(d < 1e-16f)
+    return Vector3f(0.0f, 0.0f, 0.0f);
+  return v * fast_rsqrt(d);
+}
+
+inline void fast_normalize(Vector2f& v)
+{
+  v = fast_unit(v);
+}
+
+inline void fast_normalize(Vector3f& v)
+{
+  v = fast_unit(v);
+}
+
+#endif
@@ -0,0 +1,202 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef HIERARCHY_H_GUARD
+#define HIERARCHY_H_GUARD
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "matrix4.h"
+#include "../threadpool/threadpool.hpp"
+
+/* World matrices for a transform hierarchy (a scene graph), stored flat:
+   node i has a local matrix and the index of its parent, -1 for a root,
+   and every parent comes before its children. Then
+     world[i] = world[parent[i]] * local[i]
+   is a single pass from front to back, with no recursion and no copies. */
+
+/* Computes every world matrix in one pass. Returns false if some parent
+   index is not smaller than its child's index. */
+template<class T>
+bool compose_hierarchy(const Matrix4<T>* local, const int* parent, size_t count, Matrix4<T>* world)
+{
+  for(size_t i=0; i<count; ++i){
+    int p = parent[i];
+    if(p < 0)
+      world[i] = local[i];
+    else if(static_cast<size_t>(p) < i)
+      Matrix4Ops<T>::multiply(world[p].m, local[i].m, world[i].m);
+    else
+      return false;
+  }
+  return true;
+}
+
+/* The same, kept up to date incrementally: setLocal marks a node dirty,
+   and update recomputes only the dirty nodes and everything below them.
+   update(pool) does the work level by level (all nodes at the same depth
+   are independent of each other), spread over the pool. */
+template<class T> class TransformHierarchy
+{
+  std::vector< Matrix4<T> > local;
+  std::vector< Matrix4<T> > world;
+  std::vector<int> parent;
+  std::vector<unsigned char> dirty;
+  std::vector<int> depth;
+  /* node indices sorted by depth, level d is levelNodes[levelStart[d]..levelStart[d+1]) */
+  std::vector<int> levelNodes;
+  std::vector<size_t> levelStart;
+  bool anyDirty;
+  bool levelsValid;
+
+public:
+  TransformHierarchy() : anyDirty(false), levelsValid(true) {}
+
+  size_t size() const { return local.size(); }
+
+  void reserve(size_t n)
+  {
+    local.reserve(n);
+    world.reserve(n);
+    parent.reserve(n);
+    dirty.reserve(n);
+    depth.reserve(n);
+  }
+
+  /* Adds a node below parentIndex (-1 for a new root) and returns its
+     index, or -1 if parentIndex is not an existing node */
+  int add(const Matrix4<T>& m, int parentIndex = -1)
+  {
+    if(parentIndex >= static_cast<int>(size()))
+      return -1;
+    local.push_back(m);
+    world.push_back(m);
+    parent.push_back(parentIndex < 0 ? -1 : parentIndex);
+    dirty.push_back(1);
+    depth.push_back(parentIndex < 0 ? 0 : depth[parentIndex] + 1);
+    anyDirty = true;
+    levelsValid = false;
+    return static_cast<int>(size()) - 1;
+  }
+
+  void clear()
+  {
+    local.clear();
+    world.clear();
+    parent.clear();
+    dirty.clear();
+    depth.clear();
+    anyDirty = false;
+    levelsValid = false;
+  }
+
+  void setLocal(int i, const Matrix4<T>& m)
+  {
+    local[i] = m;
+    dirty[i] = 1;
+    anyDirty = true;
+  }
+
+  const Matrix4<T>& getLocal(int i) const { return local[i]; }
+  int getParent(int i) const { return parent[i]; }
+
+  /* Up to date after the last update */
+  const Matrix4<T>& getWorld(int i) const { return world[i]; }
+  const Matrix4<T>* worldMatrices() const { return world.empty() ? 0 : &world[0]; }
+
+  void update()
+  {
+    if(!anyDirty)
+      return;
+    for(size_t i=0; i<size(); ++i)
+      updateNode(static_cast<int>(i));
+    finish();
+  }
+
+  void update(ThreadPool& pool)
+  {
+    if(!anyDirty || size() == 0)
+      return;
+    buildLevels();
+    for(size_t d=0; d+1<levelStart.size(); ++d){
+      const int* nodes = &levelNodes[0];
+      pool.ParallelFor(levelStart[d], levelStart[d+1], 256,
+		       [this, nodes](size_t first, size_t last) {
+			 for(size_t k=first; k<last; ++k)
+			   updateNode(nodes[k]);
+		       });
+    }
+    finish();
+  }
+
+private:
+  /* A node is recomputed if it or its parent changed in this update; the
+     flag is passed down so that the children see it */
+  void updateNode(int i)
+  {
+    int p = parent[i];
+    if(p >= 0 && dirty[p])
+      dirty[i] = 1;
+    if(!dirty[i])
+      return;
+    if(p < 0)
+      world[i] = local[i];
+    else
+      Matrix4Ops<T>::multiply(world[p].m, local[i].m, world[i].m);
+  }
+
+  void finish()
+  {
+    std::fill(dirty.begin(), dirty.end(), 0);
+    anyDirty = false;
+  }
+
+  /* Counting sort of the nodes by depth */
+  void buildLevels()
+  {
+    if(levelsValid)
+      return;
+    int levels = 0;
+    for(size_t i=0; i<depth.size(); ++i)
+      levels = std::max(levels, depth[i] + 1);
+    levelStart.assign(levels + 1, 0);
+    for(size_t i=0; i<depth.size(); ++i)
+      ++levelStart[depth[i] + 1];
+    for(int d=0; d<levels; ++d)
+      levelStart[d+1] += levelStart[d];
+    std::vector<size_t> fill(levelStart.begin(), levelStart.end() - 1);
+    levelNodes.resize(depth.size());
+    for(size_t i=0; i<depth.size(); ++i)
+      levelNodes[fill[depth[i]]++] = static_cast<int>(i);
+    levelsValid = true;
+  }
+};
+
+typedef TransformHierarchy<float> TransformHierarchyf;
+typedef TransformHierarchy<double> TransformHierarchyd;
+
+#endif
@@ -0,0 +1,374 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef INTERSECT_H_GUARD
+#define INTERSECT_H_GUARD
+#include <cmath>
+#include <cfloat>
+#include <cstddef>
+#include <algorithm>
+#include "simd.h"
+#include "vector2.h"
+#include "vector3.h"
+#include "vectorarray.h"
+#include "boundingbox.h"
+
+/* Intersection tests. The ray ones are parametric: the ray is
+   origin + t*dir for t in [0, tmax], and a hit gives the first t where the
+   ray is in the solid, so t is 0 for a ray that starts inside a box,
+   sphere or polygon. dir needn't be unit length, t is in units of it; it
+   must not be zero for spheres. The overlap ones are boolean, and
+   touching counts as overlapping. Polygons are convex, with the corners
+   in order, either way around.
+
+   The ray casts also come in packets of SIMDF_WIDTH rays (16 with
+   -mavx512f, 8 with AVX, 4 with SSE or NEON, see simd.h), tested against
+   one shape in one pass, and intersect_ray_triangles tests one ray
+   against a stream of triangles. The packet versions return a mask with
+   bit i set for a hit of ray i, and leave the hit t of ray i in t[i]; the
+   other t[i] are garbage. They give the same answers as the single ray
+   versions, up to the last bit when the target has fused multiply-add. */
+
+inline bool intersect_ray_box(const Vector3f& origin, const Vector3f& dir, const BoundingBox& box,
+			      float tmax, float& t)
+{
+  float ix = ray_inverse(dir.x), iy = ray_inverse(dir.y), iz = ray_inverse(dir.z);
+  float x0 = (box.lo.x - origin.x) * ix, x1 = (box.hi.x - origin.x) * ix;
+  float y0 = (box.lo.y - origin.y) * iy, y1 = (box.hi.y - origin.y) * iy;
+  float z0 = (box.lo.z - origin.z) * iz, z1 = (box.hi.z - origin.z) * iz;
+  float enter = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.0f));
+  float leave = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::min(std::max(z0, z1), tmax));
+  t = enter;
+  return enter <= leave;
+}
+
+inline bool intersect_ray_sphere(const Vector3f& origin, const Vector3f& dir, const Vector3f& center, float radius,
+				 float tmax, float& t)
+{
+  Vector3f oc = origin - center;
+  float a = dot(dir, dir);
+  float b = dot(oc, dir);
+  float c = dot(oc, oc) - radius * radius;
+  float disc = b * b - a * c;
+  float root = std::sqrt(std::max(disc, 0.0f));
+  float leave = (root - b) / a;
+  t = std::max((-b - root) / a, 0.0f);
+  return 0.0f <= disc && 0.0f <= leave && t <= tmax;
+}
+
+/* Both sides of the triangle (a, b, c) count (Moller and Trumbore). u and
+   v are the barycentric coordinates of the hit, which is
+   a + u*(b - a) + v*(c - a). A ray in the plane of the triangle misses. */
+inline bool intersect_ray_triangle(const Vector3f& origin, const Vector3f& dir,
+				   const Vector3f& a, const Vector3f& b, const Vector3f& c,
+				   float tmax, float& t, float& u, float& v)
+{
+  Vector3f e1 = b - a, e2 = c - a;
+  Vector3f p = cross(dir, e2);
+  float inv = 1.0f / dot(e1, p);
+  Vector3f s = origin - a;
+  Vector3f q = cross(s, e1);
+  u = dot(s, p) * inv;
+  v = dot(dir, q) * inv;
+  t = dot(e2, q) * inv;
+  /* written so that NaN, from a ray parallel to the triangle, misses,
+     and with & since the branches of && would mispredict */
+  return (0.0f <= u) & (0.0f <= v) & (u + v <= 1.0f) & (0.0f <= t) & (t <= tmax);
+}
+
+/* The ray origin + t*dir for t in [0, tmax] against a convex polygon in
+   the plane (Cyrus and Beck) */
+inline bool intersect_ray_polygon(const Vector2f& origin, const Vector2f& dir, const Vector2f* poly, size_t count,
+				  float tmax, float& t)
+{
+  if(count < 3)
+    return false;
+  float area = 0.0f;
+  for(size_t i=0, j=count-1; i<count; j=i++)
+    area += poly[j].x * poly[i].y - poly[i].x * poly[j].y;
+  float side = (area < 0.0f) ? -1.0f : 1.0f;
+  float enter = 0.0f, leave = tmax;
+  for(size_t i=0, j=count-1; i<count; j=i++){
+    /* the outward normal of the edge from poly[j] to poly[i] */
+    Vector2f e = poly[i] - poly[j];
+    Vector2f n(e.y * side, -e.x * side);
+    float num = dot(n, poly[j] - origin);
+    float den = dot(n, dir);
+    if(den == 0.0f){
+      if(num < 0.0f)
+	return false;
+    } else if(den < 0.0f)
+      enter = std::max(enter, num / den);
+    else
+      leave = std::min(leave, num / den);
+    if(enter > leave)
+      return false;
+  }
+  t = enter;
+  return true;
+}
+
+inline bool overlap_sphere_sphere(const Vector3f& c1, float r1, const Vector3f& c2, float r2)
+{
+  Vector3f d = c2 - c1;
+  return dot(d, d) <= (r1 + r2) * (r1 + r2);
+}
+
+inline bool overlap_sphere_box(const Vector3f& center, float radius, const BoundingBox& box)
+{
+  return box.distance2(center) <= radius * radius;
+}
+
+inline bool overlap_circle_circle(const Vector2f& c1, float r1, const Vector2f& c2, float r2)
+{
+  Vector2f d = c2 - c1;
+  return dot(d, d) <= (r1 + r2) * (r1 + r2);
+}
+
+/* Squared distance from p to the segment from a to b */
+inline float segment_distance2(const Vector2f& p, const Vector2f& a, const Vector2f& b)
+{
+  Vector2f e = b - a, d = p - a;
+  float len2 = dot(e, e);
+  float s = (len2 > 0.0f) ? std::min(std::max(dot(d, e) / len2, 0.0f), 1.0f) : 0.0f;
+  d = p - (a + e * s);
+  return dot(d, d);
+}
+
+inline bool overlap_circle_polygon(const Vector2f& center, float radius, const Vector2f* poly, size_t count)
+{
+  if(count == 0)
+    return false;
+  bool inside = count >= 3;
+  int turn = 0;
+  float d2 = FLT_MAX;
+  for(size_t i=0, j=count-1; i<count; j=i++){
+    Vector2f e = poly[i] - poly[j], d = center - poly[j];
+    float c = e.x * d.y - e.y * d.x;
+    int s = (c > 0.0f) - (c < 0.0f);
+    if(s != 0){
+      if(turn != 0 && s != turn)
+	inside = false;
+      turn = s;
+    }
+    d2 = std::min(d2, segment_distance2(center, poly[j], poly[i]));
+  }
+  return inside || d2 <= radius * radius;
+}
+
+/* Separating axis test: convex polygons overlap unless the normal of one
+   of their edges separates them */
+inline bool overlap_polygon_polygon(const Vector2f* p, size_t pcount, const Vector2f* q, size_t qcount)
+{
+  if(pcount == 0 || qcount == 0)
+    return false;
+  for(int k=0; k<2; ++k){
+    const Vector2f* poly = k ? q : p;
+    size_t count = k ? qcount : pcount;
+    for(size_t i=0, j=count-1; i<count; j=i++){
+      Vector2f axis(poly[j].y - poly[i].y, poly[i].x - poly[j].x);
+      float pmin = FLT_MAX, pmax = -FLT_MAX, qmin = FLT_MAX, qmax = -FLT_MAX;
+      for(size_t l=0; l<pcount; ++l){
+	float d = dot(axis, p[l]);
+	pmin = std::min(pmin, d);
+	pmax = std::max(pmax, d);
+      }
+      for(size_t l=0; l<qcount; ++l){
+	float d = dot(axis, q[l]);
+	qmin = std::min(qmin, d);
+	qmax = std::max(qmax, d);
+      }
+      if(pmax < qmin || qmax < pmin)
+	return false;
+    }
+  }
+  return true;
+}
+
+/* SIMDF_WIDTH rays, stored by component. Lanes that were not set never
+   hit anything. Aligned to SIMD_ALIGNMENT: before C++17, new and
+   std::vector don't align it, so allocate arrays of them with simd_alloc. */
+struct alignas(SIMD_ALIGNMENT) RayPacket
+{
+  float ox[SIMDF_WIDTH], oy[SIMDF_WIDTH], oz[SIMDF_WIDTH];
+  float dx[SIMDF_WIDTH], dy[SIMDF_WIDTH], dz[SIMDF_WIDTH];
+  /* ray_inverse of the direction */
+  float ix[SIMDF_WIDTH], iy[SIMDF_WIDTH], iz[SIMDF_WIDTH];
+  float tmax[SIMDF_WIDTH];
+
+  RayPacket()
+  {
+    for(int i=0; i<SIMDF_WIDTH; ++i)
+      unset(i);
+  }
+
+  void set(int lane, const Vector3f& origin, const Vector3f& dir, float maxT)
+  {
+    ox[lane] = origin.x; oy[lane] = origin.y; oz[lane] = origin.z;
+    dx[lane] = dir.x; dy[lane] = dir.y; dz[lane] = dir.z;
+    ix[lane] = ray_inverse(dir.x); iy[lane] = ray_inverse(dir.y); iz[lane] = ray_inverse(dir.z);
+    tmax[lane] = maxT;
+  }
+
+  void unset(int lane)
+  {
+    set(lane, Vector3f(0.0f, 0.0f, 0.0f), Vector3f(1.0f, 0.0f, 0.0f), -1.0f);
+  }
+};
+
+/* Three packs, one vector per lane */
+struct simdf3
+{
+  simdf x, y, z;
+};
+
+inline simdf3 simdf3_splat(const Vector3f& v)
+{
+  simdf3 r = { simdf_splat(v.x), simdf_splat(v.y), simdf_splat(v.z) };
+  return r;
+}
+
+inline simdf3 simdf3_load(const float* x, const float* y, const float* z)
+{
+  simdf3 r = { simdf_load(x), simdf_load(y), simdf_load(z) };
+  return r;
+}
+
+inline simdf3 simdf3_sub(const simdf3& a, const simdf3& b)
+{
+  simdf3 r = { simdf_sub(a.x, b.x), simdf_sub(a.y, b.y), simdf_sub(a.z, b.z) };
+  return r;
+}
+
+inline simdf simdf3_dot(const simdf3& a, const simdf3& b)
+{
+  return simdf_madd(a.z, b.z, simdf_madd(a.y, b.y, simdf_mul(a.x, b.x)));
+}
+
+inline simdf3 simdf3_cross(const simdf3& a, const simdf3& b)
+{
+  simdf3 r = { simdf_sub(simdf_mul(a.y, b.z), simdf_mul(a.z, b.y)),
+	       simdf_sub(simdf_mul(a.z, b.x), simdf_mul(a.x, b.z)),
+	       simdf_sub(simdf_mul(a.x, b.y), simdf_mul(a.y, b.x)) };
+  return r;
+}
+
+/* intersect_ray_triangle for a pack of rays or triangles, or both */
+inline int simdf_ray_triangle(const simdf3& origin, const simdf3& dir, simdf tmax,
+			      const simdf3& a, const simdf3& b, const simdf3& c, simdf& t)
+{
+  simdf3 e1 = simdf3_sub(b, a), e2 = simdf3_sub(c, a);
+  simdf3 p = simdf3_cross(dir, e2);
+  simdf inv = simdf_div(simdf_splat(1.0f), simdf3_dot(e1, p));
+  simdf3 s = simdf3_sub(origin, a);
+  simdf3 q = simdf3_cross(s, e1);
+  simdf u = simdf_mul(simdf3_dot(s, p), inv);
+  simdf v = simdf_mul(simdf3_dot(dir, q), inv);
+  t = simdf_mul(simdf3_dot(e2, q), inv);
+  simdf zero = simdf_splat(0.0f);
+  return simdf_lessequalmask(zero, u) & simdf_lessequalmask(zero, v)
+    & simdf_lessequalmask(simdf_add(u, v), simdf_splat(1.0f))
+    & simdf_lessequalmask(zero, t) & simdf_lessequalmask(t, tmax);
+}
+
+inline int intersect_ray_box(const RayPacket& rays, const BoundingBox& box, float* t)
+{
+  simdf ix = simdf_load(rays.ix), iy = simdf_load(rays.iy), iz = simdf_load(rays.iz);
+  simdf ox = simdf_load(rays.ox), oy = simdf_load(rays.oy), oz = simdf_load(rays.oz);
+  simdf x0 = simdf_mul(simdf_sub(simdf_splat(box.lo.x), ox), ix), x1 = simdf_mul(simdf_sub(simdf_splat(box.hi.x), ox), ix);
+  simdf y0 = simdf_mul(simdf_sub(simdf_splat(box.lo.y), oy), iy), y1 = simdf_mul(simdf_sub(simdf_splat(box.hi.y), oy), iy);
+  simdf z0 = simdf_mul(simdf_sub(simdf_splat(box.lo.z), oz), iz), z1 = simdf_mul(simdf_sub(simdf_splat(box.hi.z), oz), iz);
+  simdf enter = simdf_max(simdf_max(simdf_min(x0, x1), simdf_min(y0, y1)),
+			  simdf_max(simdf_min(z0, z1), simdf_splat(0.0f)));
+  simdf leave = simdf_min(simdf_min(simdf_max(x0, x1), simdf_max(y0, y1)),
+			  simdf_min(simdf_max(z0, z1), simdf_load(rays.tmax)));
+  simdf_store(t, enter);
+  return simdf_lessequalmask(enter, leave);
+}
+
+inline int intersect_ray_sphere(const RayPacket& rays, const Vector3f& center, float radius, float* t)
+{
+  simdf3 oc = simdf3_sub(simdf3_load(rays.ox, rays.oy, rays.oz), simdf3_splat(center));
+  simdf3 dir = simdf3_load(rays.dx, rays.dy, rays.dz);
+  simdf a = simdf3_dot(dir, dir);
+  simdf b = simdf3_dot(oc, dir);
+  simdf c = simdf_sub(simdf3_dot(oc, oc), simdf_splat(radius * radius));
+  simdf disc = simdf_sub(simdf_mul(b, b), simdf_mul(a, c));
+  simdf zero = simdf_splat(0.0f);
+  simdf root = simdf_sqrt(simdf_max(disc, zero));
+  simdf leave = simdf_div(simdf_sub(root, b), a);
+  simdf enter = simdf_max(simdf_div(simdf_sub(simdf_sub(zero, b), root), a), zero);
+  simdf_store(t, enter);
+  return simdf_lessequalmask(zero, disc) & simdf_lessequalmask(zero, leave)
+    & simdf_lessequalmask(enter, simdf_load(rays.tmax));
+}
+
+inline int intersect_ray_triangle(const RayPacket& rays, const Vector3f& a, const Vector3f& b, const Vector3f& c,
+				  float* t)
+{
+  simdf ts;
+  int mask = simdf_ray_triangle(simdf3_load(rays.ox, rays.oy, rays.oz), simdf3_load(rays.dx, rays.dy, rays.dz),
+				simdf_load(rays.tmax), simdf3_splat(a), simdf3_splat(b), simdf3_splat(c), ts);
+  simdf_store(t, ts);
+  return mask;
+}
+
+/* The nearest of the triangles (a[i], b[i], c[i]) that the ray hits
+   within tmax, or -1. tmax becomes the t of the hit. On equal t the lower
+   index wins. */
+inline int intersect_ray_triangles(const Vector3f& origin, const Vector3f& dir, float& tmax,
+				   const Vector3Array& a, const Vector3Array& b, const Vector3Array& c)
+{
+  size_t count = std::min(a.size(), std::min(b.size(), c.size()));
+  simdf3 o = simdf3_splat(origin), d = simdf3_splat(dir);
+  simdf limit = simdf_splat(tmax);
+  int result = -1;
+  alignas(SIMD_ALIGNMENT) float t[SIMDF_WIDTH];
+  for(size_t i=0; i<count; i+=SIMDF_WIDTH){
+    simdf ts;
+    int mask = simdf_ray_triangle(o, d, limit,
+				  simdf3_load(a.x() + i, a.y() + i, a.z() + i),
+				  simdf3_load(b.x() + i, b.y() + i, b.z() + i),
+				  simdf3_load(c.x() + i, c.y() + i, c.z() + i), ts);
+    if(count - i < SIMDF_WIDTH)
+      mask &= (1 << (count - i)) - 1;
+    if(!mask)
+      continue;
+    simdf_store(t, ts);
+    for(int l=0; l<SIMDF_WIDTH; ++l){
+      if((mask >> l & 1) && (result < 0 || t[l] < tmax)){
+	tmax = t[l];
+	result = static_cast<int>(i) + l;
+      }
+    }
+    limit = simdf_splat(tmax);
+  }
+  return result;
+}
+
+#endif
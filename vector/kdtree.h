@@ -0,0 +1,386 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef KDTREE_H_GUARD
+#define KDTREE_H_GUARD
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstddef>
+#include "vector3.h"
+#include "../threadpool/threadpool.hpp"
+
+/* k-d tree over a static set of points, for k nearest neighbour and
+   radius queries. The tree is implicit: the points are reordered so that
+   the node of a range [first, last) is the point at the middle, mid =
+   first + (last - first)/2, with the points before it on one side of its
+   split plane and the points after it on the other. Ranges of at most
+   LEAF points are leaves and are scanned. So there are no child links,
+   just the points and one byte per point for the split axis, the one
+   along which the points of the range spread the most.
+
+   Everything compares squared distances, no square roots. Results are
+   reported by the index the point had in the array given to build. Ties
+   in distance go to the lower index, so the answers don't depend on the
+   build or the traversal order. The ThreadPool build builds the two
+   halves of big ranges as separate tasks, and gives the same tree; the
+   batch queries split the batch over the pool. A batch runs faster when
+   queries next to each other in it are close in space. */
+template<class T> class KDTree
+{
+public:
+  KDTree(){}
+
+  void build(const Vector3<T>* points, size_t count)
+  {
+    buildTree(0, points, count);
+  }
+  void build(const std::vector<Vector3<T> >& points)
+  {
+    buildTree(0, points.empty() ? 0 : &points[0], points.size());
+  }
+  void build(ThreadPool& pool, const Vector3<T>* points, size_t count)
+  {
+    buildTree(&pool, points, count);
+  }
+  void build(ThreadPool& pool, const std::vector<Vector3<T> >& points)
+  {
+    buildTree(&pool, points.empty() ? 0 : &points[0], points.size());
+  }
+
+  void clear()
+  {
+    entries.clear();
+    axes.clear();
+  }
+
+  size_t size() const { return entries.size(); }
+
+  /* The k points nearest to p and no farther than sqrt(maxDist2), nearest
+     first: their indices go to index[0...] and their squared distances to
+     dist2[0...]. Returns how many were found, at most k. */
+  size_t nearest(const Vector3<T>& p, size_t k, int* index, T* dist2,
+		 T maxDist2 = std::numeric_limits<T>::max()) const
+  {
+    if(k == 0)
+      return 0;
+    Heap heap(index, dist2, k);
+    T limit = maxDist2;
+    search(p, limit, [&](const Entry& e) {
+	Vector3<T> d = e.p - p;
+	T d2 = dot(d, d);
+	if(d2 <= limit && heap.add(d2, e.index))
+	  limit = heap.full() ? heap.worst() : maxDist2;
+      });
+    heap.sort();
+    return heap.size();
+  }
+
+  /* The nearest point no farther than sqrt(dist2), or -1. dist2 becomes
+     its squared distance. */
+  int nearest(const Vector3<T>& p, T& dist2) const
+  {
+    int index = -1;
+    T d2;
+    if(nearest(p, 1, &index, &d2, dist2))
+      dist2 = d2;
+    return index;
+  }
+
+  /* Calls f(i, d2) for every point i within radius of p, where d2 is its
+     squared distance to p */
+  template<class F>
+  void within(const Vector3<T>& p, T radius, F f) const
+  {
+    const T r2 = radius * radius;
+    search(p, r2, [&](const Entry& e) {
+	Vector3<T> d = e.p - p;
+	T d2 = dot(d, d);
+	if(d2 <= r2)
+	  f(e.index, d2);
+      });
+  }
+
+  /* nearest(queries[i], k, ...) for every query, into rows of k:
+     index[i*k + j] and dist2[i*k + j]. Rows with fewer than k points end
+     in -1 and std::numeric_limits<T>::max(). */
+  void nearest(const Vector3<T>* queries, size_t count, size_t k, int* index, T* dist2,
+	       T maxDist2 = std::numeric_limits<T>::max()) const
+  {
+    nearestRange(queries, 0, count, k, index, dist2, maxDist2);
+  }
+
+  void nearest(ThreadPool& pool, const Vector3<T>* queries, size_t count, size_t k, int* index, T* dist2,
+	       T maxDist2 = std::numeric_limits<T>::max()) const
+  {
+    pool.ParallelFor(0, count, BATCH_GRAIN, [&](size_t first, size_t last) {
+	nearestRange(queries, first, last, k, index, dist2, maxDist2);
+      });
+  }
+
+  /* within(queries[i], radius) for every query: the points found for
+     query i are indices[offsets[i], offsets[i + 1]), in no particular
+     order (but the same every time) */
+  void within(const Vector3<T>* queries, size_t count, T radius,
+	      std::vector<size_t>& offsets, std::vector<int>& indices) const
+  {
+    offsets.assign(count + 1, 0);
+    indices.clear();
+    for(size_t i=0; i<count; ++i){
+      within(queries[i], radius, [&](int j, T) { indices.push_back(j); });
+      offsets[i + 1] = indices.size();
+    }
+  }
+
+  void within(ThreadPool& pool, const Vector3<T>* queries, size_t count, T radius,
+	      std::vector<size_t>& offsets, std::vector<int>& indices) const
+  {
+    offsets.assign(count + 1, 0);
+    std::vector<std::vector<int> > parts((count + BATCH_GRAIN - 1) / BATCH_GRAIN);
+    pool.ParallelFor(0, count, BATCH_GRAIN, [&](size_t first, size_t last) {
+	std::vector<int>& part = parts[first / BATCH_GRAIN];
+	for(size_t i=first; i<last; ++i){
+	  within(queries[i], radius, [&](int j, T) { part.push_back(j); });
+	  offsets[i + 1] = part.size();
+	}
+      });
+    /* the counts within each part to offsets into the whole */
+    size_t base = 0;
+    for(size_t c=0; c<parts.size(); ++c){
+      size_t last = std::min(count, (c + 1) * BATCH_GRAIN);
+      for(size_t i=c*BATCH_GRAIN; i<last; ++i)
+	offsets[i + 1] += base;
+      base += parts[c].size();
+    }
+    indices.resize(base);
+    pool.ParallelFor(0, parts.size(), 1, [&](size_t first, size_t last) {
+	for(size_t c=first; c<last; ++c)
+	  if(!parts[c].empty())
+	    std::copy(parts[c].begin(), parts[c].end(), indices.begin() + offsets[c * BATCH_GRAIN]);
+      });
+  }
+
+private:
+  static const size_t LEAF = 8;
+  static const size_t PARALLEL_SUBTREE = 16384;
+  static const size_t BATCH_GRAIN = 256;
+  /* The depth of a tree with 2^64 points, and so the most far sides a
+     search can have put aside */
+  static const int STACK = 64;
+
+  struct Entry
+  {
+    Vector3<T> p;
+    int index;
+  };
+
+  std::vector<Entry> entries;
+  std::vector<unsigned char> axes;
+
+  static T coord(const Vector3<T>& p, int axis)
+  {
+    return axis == 0 ? p.x : (axis == 1 ? p.y : p.z);
+  }
+
+  /* The k best (squared distance, index) pairs so far, as a max-heap on
+     the caller's arrays, the worst at the top */
+  class Heap
+  {
+    int* index;
+    T* dist2;
+    size_t capacity, count;
+
+    bool worse(size_t a, size_t b) const
+    {
+      return dist2[a] > dist2[b] || (dist2[a] == dist2[b] && index[a] > index[b]);
+    }
+    void swap(size_t a, size_t b)
+    {
+      std::swap(index[a], index[b]);
+      std::swap(dist2[a], dist2[b]);
+    }
+    void siftDown(size_t i, size_t n)
+    {
+      while(true){
+	size_t c = 2 * i + 1;
+	if(c >= n)
+	  return;
+	if(c + 1 < n && worse(c + 1, c))
+	  ++c;
+	if(!worse(c, i))
+	  return;
+	swap(i, c);
+	i = c;
+      }
+    }
+
+  public:
+    Heap(int* index, T* dist2, size_t k) : index(index), dist2(dist2), capacity(k), count(0){}
+
+    size_t size() const { return count; }
+    bool full() const { return count == capacity; }
+    T worst() const { return dist2[0]; }
+
+    /* false if (d2, i) is no better than the worst of a full heap */
+    bool add(T d2, int i)
+    {
+      if(count < capacity){
+	size_t c = count++;
+	index[c] = i;
+	dist2[c] = d2;
+	while(c > 0 && worse(c, (c - 1) / 2)){
+	  swap(c, (c - 1) / 2);
+	  c = (c - 1) / 2;
+	}
+	return true;
+      }
+      if(d2 > dist2[0] || (d2 == dist2[0] && i > index[0]))
+	return false;
+      index[0] = i;
+      dist2[0] = d2;
+      siftDown(0, count);
+      return true;
+    }
+
+    /* nearest first */
+    void sort()
+    {
+      for(size_t n=count; n>1; --n){
+	swap(0, n - 1);
+	siftDown(0, n - 1);
+      }
+    }
+  };
+
+  /* Calls visit(entry) for the points that may be within sqrt(limit) of
+     p: every point of every range whose lower bound on the squared
+     distance is at most limit. visit may lower limit. */
+  template<class V>
+  void search(const Vector3<T>& p, const T& limit, V visit) const
+  {
+    if(entries.empty())
+      return;
+    size_t stackFirst[STACK], stackLast[STACK];
+    T stackBound[STACK];
+    int sp = 0;
+    size_t first = 0, last = entries.size();
+    T bound = T(0);
+    while(true){
+      if(bound <= limit){
+	while(last - first > LEAF){
+	  size_t mid = first + (last - first) / 2;
+	  int axis = axes[mid];
+	  T diff = coord(p, axis) - coord(entries[mid].p, axis);
+	  visit(entries[mid]);
+	  /* the near side now, the far side later if it can still be close
+	     enough */
+	  T farBound = std::max(bound, diff * diff);
+	  size_t farFirst = first, farLast = mid;
+	  if(diff < T(0)){
+	    farFirst = mid + 1;
+	    farLast = last;
+	    last = mid;
+	  } else
+	    first = mid + 1;
+	  if(farBound <= limit && farLast > farFirst){
+	    stackFirst[sp] = farFirst;
+	    stackLast[sp] = farLast;
+	    stackBound[sp++] = farBound;
+	  }
+	}
+	for(size_t i=first; i<last; ++i)
+	  visit(entries[i]);
+      }
+      if(sp == 0)
+	return;
+      --sp;
+      first = stackFirst[sp];
+      last = stackLast[sp];
+      bound = stackBound[sp];
+    }
+  }
+
+  void nearestRange(const Vector3<T>* queries, size_t first, size_t last, size_t k,
+		    int* index, T* dist2, T maxDist2) const
+  {
+    for(size_t i=first; i<last; ++i){
+      size_t found = nearest(queries[i], k, index + i * k, dist2 + i * k, maxDist2);
+      std::fill(index + i * k + found, index + (i + 1) * k, -1);
+      std::fill(dist2 + i * k + found, dist2 + (i + 1) * k, std::numeric_limits<T>::max());
+    }
+  }
+
+  void buildTree(ThreadPool* pool, const Vector3<T>* points, size_t count)
+  {
+    entries.resize(count);
+    axes.assign(count, 0);
+    for(size_t i=0; i<count; ++i){
+      entries[i].p = points[i];
+      entries[i].index = static_cast<int>(i);
+    }
+    buildRange(pool, 0, count);
+  }
+
+  void buildRange(ThreadPool* pool, size_t first, size_t last)
+  {
+    if(last - first <= LEAF)
+      return;
+    Vector3<T> lo = entries[first].p, hi = lo;
+    for(size_t i=first + 1; i<last; ++i){
+      const Vector3<T>& p = entries[i].p;
+      lo = Vector3<T>(std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z));
+      hi = Vector3<T>(std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z));
+    }
+    Vector3<T> d = hi - lo;
+    int axis = (d.x >= d.y && d.x >= d.z) ? 0 : (d.y >= d.z ? 1 : 2);
+    size_t mid = first + (last - first) / 2;
+    typename std::vector<Entry>::iterator f = entries.begin() + first, m = entries.begin() + mid;
+    typename std::vector<Entry>::iterator l = entries.begin() + last;
+    if(axis == 0)
+      std::nth_element(f, m, l, [](const Entry& a, const Entry& b) { return a.p.x < b.p.x; });
+    else if(axis == 1)
+      std::nth_element(f, m, l, [](const Entry& a, const Entry& b) { return a.p.y < b.p.y; });
+    else
+      std::nth_element(f, m, l, [](const Entry& a, const Entry& b) { return a.p.z < b.p.z; });
+    axes[mid] = static_cast<unsigned char>(axis);
+    if(pool && last - first >= PARALLEL_SUBTREE){
+      TaskGroup group;
+      pool->Run(group, [this, pool, first, mid]() { buildRange(pool, first, mid); });
+      buildRange(pool, mid + 1, last);
+      pool->Wait(group);
+    } else {
+      buildRange(pool, first, mid);
+      buildRange(pool, mid + 1, last);
+    }
+  }
+};
+
+typedef KDTree<float> KDTreef;
+typedef KDTree<double> KDTreed;
+
+#endif
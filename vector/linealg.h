@@ -28,10 +28,15 @@
 #ifndef LINEALG_H_GUARD
 #define LINEALG_H_GUARD
 #include <cstdlib>
+#include <vector>
+#include <atomic>
+#include <stdint.h>
 #include "vector2.h"
 #include "vector3.h"
 #include "vector4.h"
 #include "matrix4.h"
+#include "vectorexpr.h"
+#include "random.h"
 
 const float PI = 3.1415926535897932384626433832f;
 
@@ -80,23 +85,21 @@ template<class T> inline T distance(const Vector4<T>& v1, const Vector4<T>& v2)
     return tmp.length();
 }
 
-/* Linear interpolation */
+/* Linear interpolation: v1 at t = 0, v2 at t = 1 */
 
 inline Vector2f mix(float t, const Vector2f& v1, const Vector2f& v2)
 {
-	return v1*(t-1.0f) + v2*t;
+	return evaluate(vexpr(v1)*(1.0f-t) + vexpr(v2)*t);
 }
 
 inline Vector3f mix(float t, const Vector3f& v1, const Vector3f& v2)
 {
-	return v1*(t-1.0f) + v2*t;
+	return evaluate(vexpr(v1)*(1.0f-t) + vexpr(v2)*t);
 }
 
 inline Vector4f mix(float t, const Vector4f& v1, const Vector4f& v2)
 {
-	Vector4f v = v1*(t-1.0f) + v2*t;
-	v.w = v1.w*(t-1.0f) + v2.w*t;
-	return v;
+	return evaluate(vexpr(v1)*(1.0f-t) + vexpr(v2)*t);
 }
 
 /***************************************
@@ -187,19 +190,33 @@ inline Vector4f project(const Vector4f& v, float width, float height)
     return proj;
 }
 
+/* randf and randv draw from a Random (see random.h) of the calling thread,
+   so threads don't contend for rand()'s lock. Each thread starts on a
+   stream of its own, numbered in the order the threads first call them;
+   randseed restarts the calling thread's generator on a given seed and
+   stream. For points that must not depend on the thread count, use the
+   bulk functions in random.h. */
+inline Random& thread_random()
+{
+  static std::atomic<uint64_t> streams(0);
+  static thread_local Random r(0, streams++);
+  return r;
+}
+
+inline void randseed(uint64_t seed, uint64_t stream = 0)
+{
+  thread_random() = Random(seed, stream);
+}
+
+/* [vmin, vmax) */
 inline float randf(float vmin, float vmax)
 {
-	return vmin + ((float)rand() / (float)RAND_MAX) * (vmax - vmin);
+	return thread_random().uniform(vmin, vmax);
 }
 
 inline Vector3f randv(const Vector3f& vmin, const Vector3f& vmax)
 {
-	Vector3f p;
-	p.x = randf(vmin.x, vmax.x);
-	p.y = randf(vmin.y, vmax.y);
-	p.z = randf(vmin.z, vmax.z);
-
-	return p;
+	return thread_random().inBox(vmin, vmax);
 }
 
 inline Vector3f BezierCurve(const Vector3f& p1, const Vector3f& p2, const Vector3f& p3, const Vector3f& p4, float t)
@@ -218,41 +235,28 @@ inline Vector3f BezierCurve(const Vector3f& p1, const Vector3f& p2, const Vector
    return p;
 }
 
+/* The Bezier curve of degree p.size()-1 with the control points p.
+   Evaluates sum C(n,k) t^k (1-t)^(n-k) p[k] Horner style, from k = n down,
+   multiplying in one more (1-t) per step, so nothing is divided by (1-t).
+   For many points on the same curve, see BezierEvaluator in bezier.h. */
 inline Vector3f BezierCurve(const std::vector<Vector3f>& p, double t)
 {
-	int kn,nn,nkn;
-	double blend,muk,munk;
-	int count = p.size();
-	Vector3f b(0.0f, 0.0f, 0.0f);
-
-	muk = 1.0;
-	munk = std::pow(1.0-t,(double)count);
-
-	for(unsigned int k=0;k<count;++k) {
-		nn = count;
-		kn = k;
-		nkn = count - k;
-		blend = muk * munk;
-		muk *= t;
-		munk /= (1.0-t);
-		while (nn >= 1) {
-			blend *= (double)nn;
-			--nn;
-			if(kn > 1) {
-				blend /= (double)kn;
-				--kn;
-			}
-			if (nkn > 1) {
-				blend /= (double)nkn;
-				--nkn;
-			}
-		}
-		float blendf = static_cast<float>(blend);
-		b.x += p[k].x * blendf;
-		b.y += p[k].y * blendf;
-		b.z += p[k].z * blendf;
+	if(p.empty())
+		return Vector3f(0.0f, 0.0f, 0.0f);
+	int n = static_cast<int>(p.size()) - 1;
+	double u = 1.0 - t;
+	double binom = 1.0;
+	double upow = 1.0;
+	double x = p[n].x, y = p[n].y, z = p[n].z;
+	for(int k=n-1; k>=0; --k){
+		binom = binom * (k + 1) / (n - k);
+		upow *= u;
+		double w = binom * upow;
+		x = x*t + w*p[k].x;
+		y = y*t + w*p[k].y;
+		z = z*t + w*p[k].z;
 	}
-	return b;
+	return Vector3f(static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
 }
 
 #endif
@@ -28,9 +28,109 @@
 #ifndef MATRIX4_H_GUARD
 #define MATRIX4_H_GUARD
 #include <algorithm>
+#include "simd.h"
 #include "vector4.h"
 
-template<class T> struct Matrix4
+/* The row-major 4x4 kernels behind Matrix4: r = a*b and r = transpose(a).
+   r must not overlap a or b. Floats go through simd.h, one row at a time. */
+template<class T> struct Matrix4Ops
+{
+  static void multiply(const T* a, const T* b, T* r)
+  {
+    for(int i=0; i<4; ++i){
+      const T* ai = a + i*4;
+      for(int j=0; j<4; ++j)
+	r[i*4 + j] = ai[0]*b[j] + ai[1]*b[4 + j] + ai[2]*b[8 + j] + ai[3]*b[12 + j];
+    }
+  }
+  static void transpose(const T* a, T* r)
+  {
+    for(int i=0; i<4; ++i)
+      for(int j=0; j<4; ++j)
+	r[j*4 + i] = a[i*4 + j];
+  }
+};
+
+template<> struct Matrix4Ops<float>
+{
+  /* row i of r is a[i][0]*b.row0 + a[i][1]*b.row1 + ... */
+  static void multiply(const float* a, const float* b, float* r)
+  {
+    simd4f b0 = simd4f_load(b), b1 = simd4f_load(b + 4);
+    simd4f b2 = simd4f_load(b + 8), b3 = simd4f_load(b + 12);
+    for(int i=0; i<4; ++i){
+      const float* ai = a + i*4;
+      simd4f row = simd4f_add(simd4f_add(simd4f_mul(simd4f_splat(ai[0]), b0),
+					 simd4f_mul(simd4f_splat(ai[1]), b1)),
+			      simd4f_add(simd4f_mul(simd4f_splat(ai[2]), b2),
+					 simd4f_mul(simd4f_splat(ai[3]), b3)));
+      simd4f_store(r + i*4, row);
+    }
+  }
+  static void transpose(const float* a, float* r)
+  {
+    simd4f r0 = simd4f_load(a), r1 = simd4f_load(a + 4);
+    simd4f r2 = simd4f_load(a + 8), r3 = simd4f_load(a + 12);
+    simd4f_transpose(r0, r1, r2, r3);
+    simd4f_store(r, r0);
+    simd4f_store(r + 4, r1);
+    simd4f_store(r + 8, r2);
+    simd4f_store(r + 12, r3);
+  }
+};
+
+/* The inverse of an affine transform, given as the top three rows a of a
+   row-major 4x4 matrix (the last row being 0 0 0 1), into the top three
+   rows r: the inverse of the 3x3 part, and the translation run back
+   through it. Matrix4 and Affine3x4 both store their leading 12
+   coefficients this way. r must not overlap a. */
+template<class T> struct AffineInverse
+{
+  /* Leaves r alone and returns false for a singular matrix */
+  static bool general(const T* a, T* r)
+  {
+    T c0 = a[5]*a[10] - a[6]*a[9];
+    T c1 = a[6]*a[8] - a[4]*a[10];
+    T c2 = a[4]*a[9] - a[5]*a[8];
+    T det = a[0]*c0 + a[1]*c1 + a[2]*c2;
+    if(det == T(0))
+      return false;
+    T d = T(1) / det;
+    r[ 0] = c0 * d;
+    r[ 1] = (a[2]*a[9] - a[1]*a[10]) * d;
+    r[ 2] = (a[1]*a[6] - a[2]*a[5]) * d;
+    r[ 4] = c1 * d;
+    r[ 5] = (a[0]*a[10] - a[2]*a[8]) * d;
+    r[ 6] = (a[2]*a[4] - a[0]*a[6]) * d;
+    r[ 8] = c2 * d;
+    r[ 9] = (a[1]*a[8] - a[0]*a[9]) * d;
+    r[10] = (a[0]*a[5] - a[1]*a[4]) * d;
+    translation(a, r);
+    return true;
+  }
+
+  /* For an orthonormal 3x3 part, whose inverse is the transpose */
+  static void rigid(const T* a, T* r)
+  {
+    r[0] = a[0]; r[1] = a[4]; r[ 2] = a[ 8];
+    r[4] = a[1]; r[5] = a[5]; r[ 6] = a[ 9];
+    r[8] = a[2]; r[9] = a[6]; r[10] = a[10];
+    translation(a, r);
+  }
+
+private:
+  /* r holds the inverse of the 3x3 part; fills in -r*t */
+  static void translation(const T* a, T* r)
+  {
+    r[ 3] = -(r[0]*a[3] + r[1]*a[7] + r[ 2]*a[11]);
+    r[ 7] = -(r[4]*a[3] + r[5]*a[7] + r[ 6]*a[11]);
+    r[11] = -(r[8]*a[3] + r[9]*a[7] + r[10]*a[11]);
+  }
+};
+
+/* Row-major: m[0..3] is the first row, and the translation of an affine
+   transform is m[3], m[7], m[11]. 16-byte aligned for the float kernels. */
+template<class T> struct alignas(16) Matrix4
 {
   T m[16];
   Matrix4(){ zero(); }
@@ -68,16 +168,102 @@ template<class T> struct Matrix4
 
   Matrix4<T> operator*(const Matrix4<T>& mat) const
   {
-    Matrix4<T> result;
-    for(int i=0; i<4; ++i){
-      for(int j=0; j<4; ++j){
-		for(int k=0; k<4; ++k){
-			result[j + i*4] += m[k + i*4]*mat[j + k*4];
-		}
-      }
-    }
+    Matrix4<T> result((NoInit()));
+    Matrix4Ops<T>::multiply(m, mat.m, result.m);
     return result;
   }
+  Matrix4<T>& operator*=(const Matrix4<T>& mat)
+  {
+    *this = *this * mat;
+    return *this;
+  }
+
+  Matrix4<T> transpose() const
+  {
+    Matrix4<T> result((NoInit()));
+    Matrix4Ops<T>::transpose(m, result.m);
+    return result;
+  }
+
+  /* The determinant and the inverse share the 2x2 minors of the top two
+     rows (s) and the bottom two rows (c), by Laplace expansion along the
+     top two rows. About 100 multiplies and one divide. */
+  T determinant() const
+  {
+    T s[6], c[6];
+    minors(s, c);
+    return s[0]*c[5] - s[1]*c[4] + s[2]*c[3] + s[3]*c[2] - s[4]*c[1] + s[5]*c[0];
+  }
+
+  /* The general inverse. A singular matrix gives the zero matrix. */
+  Matrix4<T> inverse() const
+  {
+    T s[6], c[6];
+    minors(s, c);
+    T det = s[0]*c[5] - s[1]*c[4] + s[2]*c[3] + s[3]*c[2] - s[4]*c[1] + s[5]*c[0];
+    Matrix4<T> r;
+    if(det == T(0))
+      return r;
+    T d = T(1) / det;
+    r.m[ 0] = ( m[ 5]*c[5] - m[ 6]*c[4] + m[ 7]*c[3]) * d;
+    r.m[ 1] = (-m[ 1]*c[5] + m[ 2]*c[4] - m[ 3]*c[3]) * d;
+    r.m[ 2] = ( m[13]*s[5] - m[14]*s[4] + m[15]*s[3]) * d;
+    r.m[ 3] = (-m[ 9]*s[5] + m[10]*s[4] - m[11]*s[3]) * d;
+    r.m[ 4] = (-m[ 4]*c[5] + m[ 6]*c[2] - m[ 7]*c[1]) * d;
+    r.m[ 5] = ( m[ 0]*c[5] - m[ 2]*c[2] + m[ 3]*c[1]) * d;
+    r.m[ 6] = (-m[12]*s[5] + m[14]*s[2] - m[15]*s[1]) * d;
+    r.m[ 7] = ( m[ 8]*s[5] - m[10]*s[2] + m[11]*s[1]) * d;
+    r.m[ 8] = ( m[ 4]*c[4] - m[ 5]*c[2] + m[ 7]*c[0]) * d;
+    r.m[ 9] = (-m[ 0]*c[4] + m[ 1]*c[2] - m[ 3]*c[0]) * d;
+    r.m[10] = ( m[12]*s[4] - m[13]*s[2] + m[15]*s[0]) * d;
+    r.m[11] = (-m[ 8]*s[4] + m[ 9]*s[2] - m[11]*s[0]) * d;
+    r.m[12] = (-m[ 4]*c[3] + m[ 5]*c[1] - m[ 6]*c[0]) * d;
+    r.m[13] = ( m[ 0]*c[3] - m[ 1]*c[1] + m[ 2]*c[0]) * d;
+    r.m[14] = (-m[12]*s[3] + m[13]*s[1] - m[14]*s[0]) * d;
+    r.m[15] = ( m[ 8]*s[3] - m[ 9]*s[1] + m[10]*s[0]) * d;
+    return r;
+  }
+
+  /* For an affine transform, with 0 0 0 1 as the last row: the inverse of
+     the upper 3x3 part, and the translation run back through it. A
+     singular matrix gives the zero matrix. */
+  Matrix4<T> inverseAffine() const
+  {
+    Matrix4<T> r;
+    if(AffineInverse<T>::general(m, r.m))
+      r.m[15] = T(1);
+    return r;
+  }
+
+  /* For rotation plus translation only (orthonormal upper 3x3, last row
+     0 0 0 1), where the inverse rotation is the transpose */
+  Matrix4<T> inverseRigid() const
+  {
+    Matrix4<T> r;
+    AffineInverse<T>::rigid(m, r.m);
+    r.m[15] = T(1);
+    return r;
+  }
+
+private:
+  struct NoInit {};
+  explicit Matrix4(NoInit){}
+
+  void minors(T* s, T* c) const
+  {
+    s[0] = m[0]*m[5] - m[4]*m[1];
+    s[1] = m[0]*m[6] - m[4]*m[2];
+    s[2] = m[0]*m[7] - m[4]*m[3];
+    s[3] = m[1]*m[6] - m[5]*m[2];
+    s[4] = m[1]*m[7] - m[5]*m[3];
+    s[5] = m[2]*m[7] - m[6]*m[3];
+    c[0] = m[ 8]*m[13] - m[12]*m[ 9];
+    c[1] = m[ 8]*m[14] - m[12]*m[10];
+    c[2] = m[ 8]*m[15] - m[12]*m[11];
+    c[3] = m[ 9]*m[14] - m[13]*m[10];
+    c[4] = m[ 9]*m[15] - m[13]*m[11];
+    c[5] = m[10]*m[15] - m[14]*m[11];
+  }
 };
 
 typedef Matrix4<int> Matrix4i;
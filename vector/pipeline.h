@@ -0,0 +1,183 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PIPELINE_H_GUARD
+#define PIPELINE_H_GUARD
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include "simd.h"
+#include "vector3.h"
+#include "vector4.h"
+#include "matrix4.h"
+#include "vectorarray.h"
+#include "../threadpool/threadpool.hpp"
+
+/* The vertex stage of a software renderer in one pass over a vertex
+   stream: model-view-projection, clip codes, perspective divide and
+   viewport mapping. Nothing is stored in between, so the cost is about
+   reading the positions and writing the results.
+
+   A clip code has a bit for every plane of the view frustum that the
+   clip space vertex (x, y, z, w) is outside of; 0 is inside. A triangle
+   whose three codes AND to nonzero is entirely outside one plane and can
+   be dropped; one whose codes OR to zero needs no clipping. */
+enum ClipCode
+{
+  CLIP_LEFT   = 1,   /* x < -w */
+  CLIP_RIGHT  = 2,   /* x >  w */
+  CLIP_BOTTOM = 4,   /* y < -w */
+  CLIP_TOP    = 8,   /* y >  w */
+  CLIP_NEAR   = 16,  /* z < -w, also everything behind the eye */
+  CLIP_FAR    = 32   /* z >  w */
+};
+
+inline unsigned char clip_code(const Vector4f& c)
+{
+  unsigned char code = 0;
+  if(c.x < -c.w) code |= CLIP_LEFT;
+  if(c.w <  c.x) code |= CLIP_RIGHT;
+  if(c.y < -c.w) code |= CLIP_BOTTOM;
+  if(c.w <  c.y) code |= CLIP_TOP;
+  if(c.z < -c.w) code |= CLIP_NEAR;
+  if(c.w <  c.z) code |= CLIP_FAR;
+  return code;
+}
+
+/* The viewport part of project() in linealg.h, after the perspective
+   divide that project() leaves to the caller: x and y in pixels, z in
+   [0, 1] and w = 1/w for perspective correct interpolation. */
+inline Vector4f viewport_point(const Vector4f& c, float width, float height)
+{
+  float cx = width * 0.5f, cy = height * 0.5f;
+  float iw = 1.0f / c.w;
+  return Vector4f(c.x * iw * cx + cx, c.y * iw * cy + cy, c.z * iw * 0.5f + 0.5f, iw);
+}
+
+/* One vertex, with the point at w = 1: out is the window position, and
+   the clip code is returned */
+inline unsigned char project_vertex(const Matrix4f& mvp, float width, float height,
+				    const Vector3f& v, Vector4f& out)
+{
+  Vector4f c;
+  c.x = v.z*mvp[ 2] + (v.y*mvp[ 1] + (v.x*mvp[ 0] + mvp[ 3]));
+  c.y = v.z*mvp[ 6] + (v.y*mvp[ 5] + (v.x*mvp[ 4] + mvp[ 7]));
+  c.z = v.z*mvp[10] + (v.y*mvp[ 9] + (v.x*mvp[ 8] + mvp[11]));
+  c.w = v.z*mvp[14] + (v.y*mvp[13] + (v.x*mvp[12] + mvp[15]));
+  out = viewport_point(c, width, height);
+  return clip_code(c);
+}
+
+/* Packs [first, last) of project_vertices, last a multiple of
+   SIMDF_WIDTH or the padded size. Returns the AND of the codes. */
+inline unsigned char project_vertices_range(const Matrix4f& mvp, float width, float height,
+					    const Vector3Array& in, Vector4Array& out, unsigned char* clip,
+					    size_t first, size_t last)
+{
+  simdf m[16];
+  for(int k=0; k<16; ++k)
+    m[k] = simdf_splat(mvp[k]);
+  simdf cx = simdf_splat(width * 0.5f), cy = simdf_splat(height * 0.5f);
+  simdf half = simdf_splat(0.5f), one = simdf_splat(1.0f);
+  const float *ix = in.x(), *iy = in.y(), *iz = in.z();
+  float *ox = out.x(), *oy = out.y(), *oz = out.z(), *ow = out.w();
+  unsigned char all = 63;
+  for(size_t i=first; i<last; i+=SIMDF_WIDTH){
+    simdf x = simdf_load(ix + i), y = simdf_load(iy + i), z = simdf_load(iz + i);
+    simdf r[4];
+    for(int row=0; row<4; ++row){
+      const simdf* mr = m + row * 4;
+      r[row] = simdf_madd(z, mr[2], simdf_madd(y, mr[1], simdf_madd(x, mr[0], mr[3])));
+    }
+#if SIMDF_WIDTH == 1
+    if(i < in.size()){
+      unsigned char c = clip_code(Vector4f(r[0], r[1], r[2], r[3]));
+      clip[i] = c;
+      all &= c;
+    }
+#else
+    /* 63 less the bits of the planes the vertex is inside of. x + w < 0
+       exactly when x < -w, rounding can't change the sign. */
+    simdf code = simdf_sub(simdf_splat(63.0f), simdf_zero_below(simdf_splat(1.0f), simdf_add(r[3], r[0]), 0.0f));
+    code = simdf_sub(code, simdf_zero_below(simdf_splat( 2.0f), simdf_sub(r[3], r[0]), 0.0f));
+    code = simdf_sub(code, simdf_zero_below(simdf_splat( 4.0f), simdf_add(r[3], r[1]), 0.0f));
+    code = simdf_sub(code, simdf_zero_below(simdf_splat( 8.0f), simdf_sub(r[3], r[1]), 0.0f));
+    code = simdf_sub(code, simdf_zero_below(simdf_splat(16.0f), simdf_add(r[3], r[2]), 0.0f));
+    code = simdf_sub(code, simdf_zero_below(simdf_splat(32.0f), simdf_sub(r[3], r[2]), 0.0f));
+    alignas(64) float codes[SIMDF_WIDTH];
+    simdf_store(codes, code);
+    size_t lanes = (in.size() > i) ? in.size() - i : 0;
+    if(lanes > SIMDF_WIDTH)
+      lanes = SIMDF_WIDTH;
+    for(size_t l=0; l<lanes; ++l){
+      unsigned char c = static_cast<unsigned char>(codes[l]);
+      clip[i + l] = c;
+      all &= c;
+    }
+#endif
+
+    simdf iw = simdf_div(one, r[3]);
+    simdf_store(ox + i, simdf_madd(simdf_mul(r[0], iw), cx, cx));
+    simdf_store(oy + i, simdf_madd(simdf_mul(r[1], iw), cy, cy));
+    simdf_store(oz + i, simdf_madd(simdf_mul(r[2], iw), half, half));
+    simdf_store(ow + i, iw);
+  }
+  return all;
+}
+
+/* The whole stream: out[i] = project_vertex(mvp, width, height, in[i])
+   (up to the last bit with fused multiply-add) and clip[i] its clip code. Vertices outside the frustum are projected
+   all the same (behind the eye that is meaningless, and w = 0 gives
+   infinities), so check clip before using them. Returns the AND of all
+   the codes: nonzero means all of in is outside one plane. The pool
+   version splits the stream into chunks, with the same results. */
+inline unsigned char project_vertices(const Matrix4f& mvp, float width, float height,
+				      const Vector3Array& in, Vector4Array& out, std::vector<unsigned char>& clip)
+{
+  out.resize(in.size());
+  clip.resize(in.size());
+  if(in.size() == 0)
+    return 0;
+  return project_vertices_range(mvp, width, height, in, out, &clip[0], 0, in.padded());
+}
+
+inline unsigned char project_vertices(ThreadPool& pool, const Matrix4f& mvp, float width, float height,
+				      const Vector3Array& in, Vector4Array& out, std::vector<unsigned char>& clip)
+{
+  out.resize(in.size());
+  clip.resize(in.size());
+  if(in.size() == 0)
+    return 0;
+  std::atomic<unsigned> all(63);
+  unsigned char* codes = &clip[0];
+  pool.ParallelFor(0, in.padded(), 4096, [&](size_t first, size_t last) {
+      all &= project_vertices_range(mvp, width, height, in, out, codes, first, last);
+    });
+  return static_cast<unsigned char>(all.load());
+}
+
+#endif
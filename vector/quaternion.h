@@ -0,0 +1,317 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef QUATERNION_H_GUARD
+#define QUATERNION_H_GUARD
+#include <cmath>
+#include "vector3.h"
+#include "vector4.h"
+#include "matrix4.h"
+#include "affine.h"
+#include "vectorarray.h"
+
+/* A rotation as a unit quaternion: x, y, z is the axis times sin(angle/2),
+   w is cos(angle/2). Composing two is 16 multiplies against 64 for two
+   Matrix4, and blending them (nlerp/slerp) needs no re-orthonormalizing.
+   The angles are in degrees and turn the same way as rotateX/Y/Z in
+   linealg.h, and q1*q2 applies q2 first, like Matrix4. */
+template<class T> struct Quaternion
+{
+  T x, y, z, w;
+
+  Quaternion() : x(T(0)), y(T(0)), z(T(0)), w(T(1)){}
+  Quaternion(T a, T b, T c, T d) : x(a), y(b), z(c), w(d){}
+
+  /* Rotation by deg degrees around axis, which need not be unit length */
+  static Quaternion<T> fromAxisAngle(const Vector3<T>& axis, T deg)
+  {
+    T half = deg * T(3.1415926535897932384626433832 / 360.0);
+    T s = std::sin(half);
+    T len = axis.length();
+    if(len == T(0))
+      return Quaternion<T>();
+    s = s / len;
+    return Quaternion<T>(axis.x * s, axis.y * s, axis.z * s, std::cos(half));
+  }
+  static Quaternion<T> rotationX(T deg) { return fromAxisAngle(Vector3<T>(T(1), T(0), T(0)), deg); }
+  static Quaternion<T> rotationY(T deg) { return fromAxisAngle(Vector3<T>(T(0), T(1), T(0)), deg); }
+  static Quaternion<T> rotationZ(T deg) { return fromAxisAngle(Vector3<T>(T(0), T(0), T(1)), deg); }
+
+  /* The rotation in the upper 3x3 part of mat, which must be orthonormal */
+  static Quaternion<T> fromMatrix(const Matrix4<T>& mat)
+  {
+    return fromRotation(mat.m, mat.m + 4, mat.m + 8);
+  }
+  static Quaternion<T> fromMatrix(const Affine3x4<T>& mat)
+  {
+    return fromRotation(mat.m, mat.m + 4, mat.m + 8);
+  }
+
+  Quaternion<T> operator*(const Quaternion<T>& q) const
+  {
+    return Quaternion<T>(w*q.x + x*q.w + y*q.z - z*q.y,
+			 w*q.y - x*q.z + y*q.w + z*q.x,
+			 w*q.z + x*q.y - y*q.x + z*q.w,
+			 w*q.w - x*q.x - y*q.y - z*q.z);
+  }
+  Quaternion<T>& operator*=(const Quaternion<T>& q)
+  {
+    *this = *this * q;
+    return *this;
+  }
+  Quaternion<T> operator-() const
+  {
+    return Quaternion<T>(-x, -y, -z, -w);
+  }
+
+  /* The inverse of a unit quaternion */
+  Quaternion<T> conjugate() const
+  {
+    return Quaternion<T>(-x, -y, -z, w);
+  }
+  Quaternion<T> inverse() const
+  {
+    T n = x*x + y*y + z*z + w*w;
+    if(n == T(0))
+      return Quaternion<T>();
+    return Quaternion<T>(-x / n, -y / n, -z / n, w / n);
+  }
+
+  T length() const
+  {
+    return std::sqrt(x*x + y*y + z*z + w*w);
+  }
+  Quaternion<T> unit() const
+  {
+    T len = length();
+    if(len < T(1e-8f))
+      return Quaternion<T>();
+    return Quaternion<T>(x / len, y / len, z / len, w / len);
+  }
+  void normalize()
+  {
+    *this = unit();
+  }
+
+  /* v + 2w(q x v) + 2q x (q x v), with q the xyz part */
+  Vector3<T> rotate(const Vector3<T>& v) const
+  {
+    T tx = T(2) * (y*v.z - z*v.y);
+    T ty = T(2) * (z*v.x - x*v.z);
+    T tz = T(2) * (x*v.y - y*v.x);
+    return Vector3<T>(v.x + w*tx + (y*tz - z*ty),
+		      v.y + w*ty + (z*tx - x*tz),
+		      v.z + w*tz + (x*ty - y*tx));
+  }
+
+  Affine3x4<T> toAffine(const Vector3<T>& translation = Vector3<T>()) const
+  {
+    Affine3x4<T> r;
+    toRotation(r.m, r.m + 4, r.m + 8);
+    r.m[3] = translation.x;
+    r.m[7] = translation.y;
+    r.m[11] = translation.z;
+    return r;
+  }
+  Matrix4<T> toMatrix4() const
+  {
+    Matrix4<T> r;
+    toRotation(r.m, r.m + 4, r.m + 8);
+    r.m[15] = T(1);
+    return r;
+  }
+
+private:
+  void toRotation(T* r0, T* r1, T* r2) const
+  {
+    T xx = x*x, yy = y*y, zz = z*z;
+    T xy = x*y, xz = x*z, yz = y*z;
+    T wx = w*x, wy = w*y, wz = w*z;
+    r0[0] = T(1) - T(2)*(yy + zz); r0[1] = T(2)*(xy - wz); r0[2] = T(2)*(xz + wy);
+    r1[0] = T(2)*(xy + wz); r1[1] = T(1) - T(2)*(xx + zz); r1[2] = T(2)*(yz - wx);
+    r2[0] = T(2)*(xz - wy); r2[1] = T(2)*(yz + wx); r2[2] = T(1) - T(2)*(xx + yy);
+  }
+
+  /* Picks the largest of w, x, y, z to divide by, for accuracy */
+  static Quaternion<T> fromRotation(const T* r0, const T* r1, const T* r2)
+  {
+    T trace = r0[0] + r1[1] + r2[2];
+    if(trace > T(0)){
+      T s = std::sqrt(trace + T(1)) * T(2);
+      return Quaternion<T>((r2[1] - r1[2]) / s, (r0[2] - r2[0]) / s, (r1[0] - r0[1]) / s, s / T(4));
+    }
+    if(r0[0] > r1[1] && r0[0] > r2[2]){
+      T s = std::sqrt(T(1) + r0[0] - r1[1] - r2[2]) * T(2);
+      return Quaternion<T>(s / T(4), (r0[1] + r1[0]) / s, (r0[2] + r2[0]) / s, (r2[1] - r1[2]) / s);
+    }
+    if(r1[1] > r2[2]){
+      T s = std::sqrt(T(1) + r1[1] - r0[0] - r2[2]) * T(2);
+      return Quaternion<T>((r0[1] + r1[0]) / s, s / T(4), (r1[2] + r2[1]) / s, (r0[2] - r2[0]) / s);
+    }
+    T s = std::sqrt(T(1) + r2[2] - r0[0] - r1[1]) * T(2);
+    return Quaternion<T>((r0[2] + r2[0]) / s, (r1[2] + r2[1]) / s, s / T(4), (r1[0] - r0[1]) / s);
+  }
+};
+
+template<class T>
+inline T dot(const Quaternion<T>& q1, const Quaternion<T>& q2)
+{
+  return q1.x*q2.x + q1.y*q2.y + q1.z*q2.z + q1.w*q2.w;
+}
+
+/* Normalized linear interpolation, along the shorter way around. The speed
+   is not quite constant, but it is cheap, and the path is the same as
+   slerp's. */
+template<class T>
+Quaternion<T> nlerp(T t, const Quaternion<T>& q1, const Quaternion<T>& q2)
+{
+  T t2 = dot(q1, q2) < T(0) ? -t : t;
+  T t1 = T(1) - t;
+  return Quaternion<T>(q1.x*t1 + q2.x*t2, q1.y*t1 + q2.y*t2,
+		       q1.z*t1 + q2.z*t2, q1.w*t1 + q2.w*t2).unit();
+}
+
+/* Spherical linear interpolation: constant angular speed, along the shorter
+   way around. Nearly equal rotations fall back to nlerp. */
+template<class T>
+Quaternion<T> slerp(T t, const Quaternion<T>& q1, const Quaternion<T>& q2)
+{
+  T c = dot(q1, q2);
+  T sign = T(1);
+  if(c < T(0)){
+    c = -c;
+    sign = T(-1);
+  }
+  if(c > T(0.9995f))
+    return nlerp(t, q1, q2);
+  T theta = std::acos(c);
+  T s = std::sin(theta);
+  T t1 = std::sin((T(1) - t) * theta) / s;
+  T t2 = sign * std::sin(t * theta) / s;
+  return Quaternion<T>(q1.x*t1 + q2.x*t2, q1.y*t1 + q2.y*t2,
+		       q1.z*t1 + q2.z*t2, q1.w*t1 + q2.w*t2);
+}
+
+typedef Quaternion<float> Quaternionf;
+typedef Quaternion<double> Quaterniond;
+
+/* Batched versions over structure-of-arrays streams (vectorarray.h), with
+   quaternions stored in a Vector4Array as x, y, z, w. Every SIMD lane is a
+   different quaternion, 4 to 16 at a time depending on the target. The
+   two inputs should have the same size. */
+
+/* out[i] = a[i] * b[i]. out may be a or b. */
+inline void quaternion_multiply(const Vector4Array& a, const Vector4Array& b, Vector4Array& out)
+{
+  if(&out != &a && &out != &b)
+    out.resize(std::min(a.size(), b.size()));
+  size_t n = std::min(out.padded(), std::min(a.padded(), b.padded()));
+  for(size_t i=0; i<n; i+=SIMDF_WIDTH){
+    simdf ax = simdf_load(a.x() + i), ay = simdf_load(a.y() + i);
+    simdf az = simdf_load(a.z() + i), aw = simdf_load(a.w() + i);
+    simdf bx = simdf_load(b.x() + i), by = simdf_load(b.y() + i);
+    simdf bz = simdf_load(b.z() + i), bw = simdf_load(b.w() + i);
+    simdf rx = simdf_sub(simdf_madd(ay, bz, simdf_madd(ax, bw, simdf_mul(aw, bx))), simdf_mul(az, by));
+    simdf ry = simdf_madd(az, bx, simdf_madd(ay, bw, simdf_sub(simdf_mul(aw, by), simdf_mul(ax, bz))));
+    simdf rz = simdf_madd(az, bw, simdf_sub(simdf_madd(ax, by, simdf_mul(aw, bz)), simdf_mul(ay, bx)));
+    simdf rw = simdf_sub(simdf_sub(simdf_sub(simdf_mul(aw, bw), simdf_mul(ax, bx)), simdf_mul(ay, by)), simdf_mul(az, bz));
+    simdf_store(out.x() + i, rx);
+    simdf_store(out.y() + i, ry);
+    simdf_store(out.z() + i, rz);
+    simdf_store(out.w() + i, rw);
+  }
+}
+
+/* out[i] = q[i].rotate(v[i]). out may be v. */
+inline void quaternion_rotate(const Vector4Array& q, const Vector3Array& v, Vector3Array& out)
+{
+  if(&out != &v)
+    out.resize(std::min(q.size(), v.size()));
+  size_t n = std::min(out.padded(), std::min(q.padded(), v.padded()));
+  simdf two = simdf_splat(2.0f);
+  for(size_t i=0; i<n; i+=SIMDF_WIDTH){
+    simdf qx = simdf_load(q.x() + i), qy = simdf_load(q.y() + i);
+    simdf qz = simdf_load(q.z() + i), qw = simdf_load(q.w() + i);
+    simdf vx = simdf_load(v.x() + i), vy = simdf_load(v.y() + i), vz = simdf_load(v.z() + i);
+    simdf tx = simdf_mul(two, simdf_sub(simdf_mul(qy, vz), simdf_mul(qz, vy)));
+    simdf ty = simdf_mul(two, simdf_sub(simdf_mul(qz, vx), simdf_mul(qx, vz)));
+    simdf tz = simdf_mul(two, simdf_sub(simdf_mul(qx, vy), simdf_mul(qy, vx)));
+    simdf_store(out.x() + i, simdf_add(simdf_madd(qw, tx, vx), simdf_sub(simdf_mul(qy, tz), simdf_mul(qz, ty))));
+    simdf_store(out.y() + i, simdf_add(simdf_madd(qw, ty, vy), simdf_sub(simdf_mul(qz, tx), simdf_mul(qx, tz))));
+    simdf_store(out.z() + i, simdf_add(simdf_madd(qw, tz, vz), simdf_sub(simdf_mul(qx, ty), simdf_mul(qy, tx))));
+  }
+}
+
+/* out[i] = nlerp(t, a[i], b[i]). out may be a or b. */
+inline void quaternion_nlerp(float t, const Vector4Array& a, const Vector4Array& b, Vector4Array& out)
+{
+  if(&out != &a && &out != &b)
+    out.resize(std::min(a.size(), b.size()));
+  size_t n = std::min(out.padded(), std::min(a.padded(), b.padded()));
+  simdf t1 = simdf_splat(1.0f - t), t2 = simdf_splat(t);
+  simdf two = simdf_splat(2.0f), one = simdf_splat(1.0f);
+  for(size_t i=0; i<n; i+=SIMDF_WIDTH){
+    simdf ax = simdf_load(a.x() + i), ay = simdf_load(a.y() + i);
+    simdf az = simdf_load(a.z() + i), aw = simdf_load(a.w() + i);
+    simdf bx = simdf_load(b.x() + i), by = simdf_load(b.y() + i);
+    simdf bz = simdf_load(b.z() + i), bw = simdf_load(b.w() + i);
+    simdf d = simdf_madd(aw, bw, simdf_madd(az, bz, simdf_madd(ay, by, simdf_mul(ax, bx))));
+    /* +t where the dot product is >= 0, -t elsewhere */
+    simdf s = simdf_mul(t2, simdf_sub(simdf_zero_below(two, d, 0.0f), one));
+    simdf rx = simdf_madd(bx, s, simdf_mul(ax, t1));
+    simdf ry = simdf_madd(by, s, simdf_mul(ay, t1));
+    simdf rz = simdf_madd(bz, s, simdf_mul(az, t1));
+    simdf rw = simdf_madd(bw, s, simdf_mul(aw, t1));
+    simdf len = simdf_sqrt(simdf_madd(rw, rw, simdf_madd(rz, rz, simdf_madd(ry, ry, simdf_mul(rx, rx)))));
+    simdf inv = simdf_zero_below(simdf_div(one, len), len, 1e-8f);
+    simdf_store(out.x() + i, simdf_mul(rx, inv));
+    simdf_store(out.y() + i, simdf_mul(ry, inv));
+    simdf_store(out.z() + i, simdf_mul(rz, inv));
+    simdf_store(out.w() + i, simdf_mul(rw, inv));
+  }
+}
+
+/* out[i] = slerp(t, a[i], b[i]). The trigonometry is done one quaternion
+   at a time, so this is much slower than quaternion_nlerp. out may be a
+   or b. */
+inline void quaternion_slerp(float t, const Vector4Array& a, const Vector4Array& b, Vector4Array& out)
+{
+  size_t n = std::min(a.size(), b.size());
+  if(&out != &a && &out != &b)
+    out.resize(n);
+  for(size_t i=0; i<n; ++i){
+    Quaternionf qa(a.x()[i], a.y()[i], a.z()[i], a.w()[i]);
+    Quaternionf qb(b.x()[i], b.y()[i], b.z()[i], b.w()[i]);
+    Quaternionf r = slerp(t, qa, qb);
+    out.x()[i] = r.x;
+    out.y()[i] = r.y;
+    out.z()[i] = r.z;
+    out.w()[i] = r.w;
+  }
+}
+
+#endif
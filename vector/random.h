@@ -0,0 +1,341 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RANDOM_H_GUARD
+#define RANDOM_H_GUARD
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include "simd.h"
+#include "vector3.h"
+#include "fastmath.h"
+#include "../threadpool/threadpool.hpp"
+
+/* Blocks per Philox4x32::generateBatch, a multiple of every SIMDF_WIDTH */
+const int RANDOM_BATCH = 16;
+
+/* Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1,
+   2, 3"): a counter-based generator. Each 128-bit counter value is
+   scrambled by ten rounds of multiplies and xors, keyed by the seed, into
+   a block of four independent 32-bit numbers. There is no state besides
+   the counter, so block i of a stream can be computed directly, by any
+   thread, in any order. It passes BigCrush, and the period per key is
+   2^130. The counter is (block index, stream), the key is the seed. */
+struct Philox4x32
+{
+  static void generate(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4])
+  {
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for(int round=0; round<10; ++round){
+      uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+      uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+      c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+      c1 = static_cast<uint32_t>(p1);
+      c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+      c3 = static_cast<uint32_t>(p0);
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+  }
+
+  static void generate(uint64_t seed, uint64_t stream, uint64_t index, uint32_t out[4])
+  {
+    uint32_t ctr[4] = { static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32),
+			static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32) };
+    uint32_t key[2] = { static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32) };
+    generate(ctr, key, out);
+  }
+
+  /* Blocks first to first+RANDOM_BATCH-1 at once, word k of block
+     first+l in out[k][l]. The blocks are independent, so their rounds
+     overlap instead of waiting on each multiply, and the compiler can
+     vectorize them. */
+  static void generateBatch(uint64_t seed, uint64_t stream, uint64_t first, uint32_t out[4][RANDOM_BATCH])
+  {
+    uint32_t c0[RANDOM_BATCH], c1[RANDOM_BATCH], c2[RANDOM_BATCH], c3[RANDOM_BATCH];
+    for(int l=0; l<RANDOM_BATCH; ++l){
+      uint64_t index = first + l;
+      c0[l] = static_cast<uint32_t>(index);
+      c1[l] = static_cast<uint32_t>(index >> 32);
+      c2[l] = static_cast<uint32_t>(stream);
+      c3[l] = static_cast<uint32_t>(stream >> 32);
+    }
+    uint32_t k0 = static_cast<uint32_t>(seed), k1 = static_cast<uint32_t>(seed >> 32);
+    for(int round=0; round<10; ++round){
+      for(int l=0; l<RANDOM_BATCH; ++l){
+	uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0[l];
+	uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2[l];
+	uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1[l] ^ k0;
+	uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3[l] ^ k1;
+	c1[l] = static_cast<uint32_t>(p1);
+	c3[l] = static_cast<uint32_t>(p0);
+	c0[l] = n0;
+	c2[l] = n2;
+      }
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+    std::memcpy(out[0], c0, sizeof(c0));
+    std::memcpy(out[1], c1, sizeof(c1));
+    std::memcpy(out[2], c2, sizeof(c2));
+    std::memcpy(out[3], c3, sizeof(c3));
+  }
+};
+
+/* [0, 1) from the top 24 bits, so every value is exact in a float */
+inline float random_unit_float(uint32_t r)
+{
+  return static_cast<float>(r >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Cube root of u in [0, 1], within 4 ulp: a first guess from dividing
+   the exponent bits by three, then two Halley steps. Four times as fast
+   as std::cbrt. */
+inline float random_cbrt(float u)
+{
+  uint32_t i;
+  std::memcpy(&i, &u, sizeof(i));
+  i = i/3 + 709921077u;
+  float y;
+  std::memcpy(&y, &i, sizeof(y));
+  for(int k=0; k<2; ++k){
+    float y3 = y*y*y;
+    y = y * (y3 + 2.0f*u) / (2.0f*y3 + u);
+  }
+  return y;
+}
+
+/* From uniform numbers to points. Uniform on the unit sphere: z is uniform
+   in [-1, 1) (Archimedes), and so is the angle around z. Uniform in the
+   ball: a point on the sphere, scaled by the cube root of a uniform
+   number, since the volume inside radius r grows as r^3. There is no
+   rejection loop, so every point is exactly one block. */
+inline Vector3f random_box_point(const uint32_t r[4], const Vector3f& vmin, const Vector3f& vmax)
+{
+  return Vector3f(vmin.x + random_unit_float(r[0]) * (vmax.x - vmin.x),
+		  vmin.y + random_unit_float(r[1]) * (vmax.y - vmin.y),
+		  vmin.z + random_unit_float(r[2]) * (vmax.z - vmin.z));
+}
+
+inline Vector3f random_sphere_point(const uint32_t r[4])
+{
+  float z = 2.0f * random_unit_float(r[0]) - 1.0f;
+  float s, c;
+  fast_sincos(6.28318530718f * random_unit_float(r[1]) - 3.14159265359f, s, c);
+  float rxy = std::sqrt(1.0f - z*z);
+  return Vector3f(rxy * c, rxy * s, z);
+}
+
+inline Vector3f random_ball_point(const uint32_t r[4], float radius)
+{
+  return random_sphere_point(r) * (radius * random_cbrt(random_unit_float(r[2])));
+}
+
+/* A generator for one thread: stream stream of seed, read from the front.
+   Different streams of the same seed are independent, so give every
+   thread, object or tile its own stream (or its own seed) instead of
+   sharing a generator. The point functions each take a whole block, so
+   the n-th point from Random(seed) is point n of the bulk functions
+   below, up to rounding in the last bit. */
+class Random
+{
+  uint64_t seed;
+  uint64_t stream;
+  uint64_t index;
+  uint32_t block[4];
+  int used;
+
+public:
+  explicit Random(uint64_t seed = 0, uint64_t stream = 0)
+    : seed(seed), stream(stream), index(0), used(4) {}
+
+  /* Continues at block n, as if n blocks had been used */
+  void seek(uint64_t n)
+  {
+    index = n;
+    used = 4;
+  }
+
+  uint32_t next()
+  {
+    if(used == 4){
+      Philox4x32::generate(seed, stream, index++, block);
+      used = 0;
+    }
+    return block[used++];
+  }
+
+  /* [0, 1) */
+  float uniform()
+  {
+    return random_unit_float(next());
+  }
+
+  /* [vmin, vmax) */
+  float uniform(float vmin, float vmax)
+  {
+    return vmin + uniform() * (vmax - vmin);
+  }
+
+  Vector3f inBox(const Vector3f& vmin, const Vector3f& vmax)
+  {
+    return random_box_point(nextBlock(), vmin, vmax);
+  }
+
+  Vector3f inBall(float radius = 1.0f)
+  {
+    return random_ball_point(nextBlock(), radius);
+  }
+
+  /* On the unit sphere */
+  Vector3f onSphere()
+  {
+    return random_sphere_point(nextBlock());
+  }
+
+private:
+  const uint32_t* nextBlock()
+  {
+    Philox4x32::generate(seed, stream, index++, block);
+    used = 4;
+    return block;
+  }
+};
+
+/* Runs map(r, x, y, z) on the batches that cover blocks first to
+   first+count-1 of stream 0 of seed, and gathers the points it makes
+   into out. Every batch starts at a multiple of RANDOM_BATCH, whatever
+   first is, so a point always comes out of the same batch and the same
+   SIMD lane, bit for bit. */
+template<class F>
+void random_points(Vector3f* out, size_t count, uint64_t seed, uint64_t first, F map)
+{
+  alignas(64) uint32_t r[4][RANDOM_BATCH];
+  alignas(64) float x[RANDOM_BATCH], y[RANDOM_BATCH], z[RANDOM_BATCH];
+  uint64_t end = first + count;
+  for(uint64_t b = first - first % RANDOM_BATCH; b < end; b += RANDOM_BATCH){
+    Philox4x32::generateBatch(seed, 0, b, r);
+    map(r, x, y, z);
+    uint64_t lo = (b < first) ? first : b;
+    uint64_t hi = (b + RANDOM_BATCH < end) ? b + RANDOM_BATCH : end;
+    for(uint64_t i=lo; i<hi; ++i)
+      out[i - first] = Vector3f(x[i - b], y[i - b], z[i - b]);
+  }
+}
+
+/* The uniform floats of word k of a batch */
+inline void random_unit_floats(const uint32_t r[RANDOM_BATCH], float* u)
+{
+  for(int l=0; l<RANDOM_BATCH; ++l)
+    u[l] = random_unit_float(r[l]);
+}
+
+inline void random_sphere_batch(const uint32_t r[4][RANDOM_BATCH], float* x, float* y, float* z)
+{
+  alignas(64) float phi[RANDOM_BATCH];
+  random_unit_floats(r[0], z);
+  random_unit_floats(r[1], phi);
+  for(int l=0; l<RANDOM_BATCH; l+=SIMDF_WIDTH){
+    simdf vz = simdf_sub(simdf_mul(simdf_load(z + l), simdf_splat(2.0f)), simdf_splat(1.0f));
+    simdf a = simdf_sub(simdf_mul(simdf_load(phi + l), simdf_splat(6.28318530718f)), simdf_splat(3.14159265359f));
+    simdf s, c;
+    simdf_fast_sincos(a, s, c);
+    simdf rxy = simdf_sqrt(simdf_sub(simdf_splat(1.0f), simdf_mul(vz, vz)));
+    simdf_store(x + l, simdf_mul(rxy, c));
+    simdf_store(y + l, simdf_mul(rxy, s));
+    simdf_store(z + l, vz);
+  }
+}
+
+/* Bulk versions: out[i] is point first + i of Random(seed), so a range
+   generated in pieces, or split over any number of threads, gives the
+   same points. The ThreadPool versions do exactly that. */
+inline void random_in_box(Vector3f* out, size_t count, const Vector3f& vmin, const Vector3f& vmax,
+			  uint64_t seed, uint64_t first = 0)
+{
+  Vector3f d = vmax - vmin;
+  random_points(out, count, seed, first,
+		[&](const uint32_t r[4][RANDOM_BATCH], float* x, float* y, float* z) {
+		  random_unit_floats(r[0], x);
+		  random_unit_floats(r[1], y);
+		  random_unit_floats(r[2], z);
+		  for(int l=0; l<RANDOM_BATCH; l+=SIMDF_WIDTH){
+		    simdf_store(x + l, simdf_madd(simdf_load(x + l), simdf_splat(d.x), simdf_splat(vmin.x)));
+		    simdf_store(y + l, simdf_madd(simdf_load(y + l), simdf_splat(d.y), simdf_splat(vmin.y)));
+		    simdf_store(z + l, simdf_madd(simdf_load(z + l), simdf_splat(d.z), simdf_splat(vmin.z)));
+		  }
+		});
+}
+
+inline void random_in_ball(Vector3f* out, size_t count, float radius, uint64_t seed, uint64_t first = 0)
+{
+  random_points(out, count, seed, first,
+		[&](const uint32_t r[4][RANDOM_BATCH], float* x, float* y, float* z) {
+		  alignas(64) float scale[RANDOM_BATCH];
+		  random_sphere_batch(r, x, y, z);
+		  for(int l=0; l<RANDOM_BATCH; ++l)
+		    scale[l] = radius * random_cbrt(random_unit_float(r[2][l]));
+		  for(int l=0; l<RANDOM_BATCH; l+=SIMDF_WIDTH){
+		    simdf k = simdf_load(scale + l);
+		    simdf_store(x + l, simdf_mul(simdf_load(x + l), k));
+		    simdf_store(y + l, simdf_mul(simdf_load(y + l), k));
+		    simdf_store(z + l, simdf_mul(simdf_load(z + l), k));
+		  }
+		});
+}
+
+inline void random_on_sphere(Vector3f* out, size_t count, uint64_t seed, uint64_t first = 0)
+{
+  random_points(out, count, seed, first, random_sphere_batch);
+}
+
+inline void random_in_box(ThreadPool& pool, Vector3f* out, size_t count, const Vector3f& vmin, const Vector3f& vmax,
+			  uint64_t seed)
+{
+  pool.ParallelFor(0, count, 4096, [=](size_t first, size_t last) {
+      random_in_box(out + first, last - first, vmin, vmax, seed, first);
+    });
+}
+
+inline void random_in_ball(ThreadPool& pool, Vector3f* out, size_t count, float radius, uint64_t seed)
+{
+  pool.ParallelFor(0, count, 4096, [=](size_t first, size_t last) {
+      random_in_ball(out + first, last - first, radius, seed, first);
+    });
+}
+
+inline void random_on_sphere(ThreadPool& pool, Vector3f* out, size_t count, uint64_t seed)
+{
+  pool.ParallelFor(0, count, 4096, [=](size_t first, size_t last) {
+      random_on_sphere(out + first, last - first, seed, first);
+    });
+}
+
+#endif
@@ -0,0 +1,419 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SIMD_H_GUARD
+#define SIMD_H_GUARD
+#include <cmath>
+#include <cstdlib>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+/* Four packed floats, and the handful of operations the vector classes
+   need. The instruction set is picked at compile time: SSE on x86
+   (always there on x86-64), NEON on AArch64, plain floats anywhere else.
+   Pass -DVECTOR_NO_SIMD to always use the plain floats.
+   The loads and stores want 16-byte aligned pointers. */
+
+#if !defined(VECTOR_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define VECTOR_SIMD_SSE
+#include <xmmintrin.h>
+#elif !defined(VECTOR_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+#define VECTOR_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(VECTOR_SIMD_SSE)
+
+typedef __m128 simd4f;
+
+inline simd4f simd4f_load(const float* p) { return _mm_load_ps(p); }
+inline void simd4f_store(float* p, simd4f a) { _mm_store_ps(p, a); }
+inline simd4f simd4f_set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+inline simd4f simd4f_splat(float s) { return _mm_set1_ps(s); }
+inline simd4f simd4f_add(simd4f a, simd4f b) { return _mm_add_ps(a, b); }
+inline simd4f simd4f_sub(simd4f a, simd4f b) { return _mm_sub_ps(a, b); }
+inline simd4f simd4f_mul(simd4f a, simd4f b) { return _mm_mul_ps(a, b); }
+inline simd4f simd4f_div(simd4f a, simd4f b) { return _mm_div_ps(a, b); }
+inline simd4f simd4f_min(simd4f a, simd4f b) { return _mm_min_ps(a, b); }
+inline simd4f simd4f_max(simd4f a, simd4f b) { return _mm_max_ps(a, b); }
+/* bit i set where lane i of a is less than lane i of b */
+inline int simd4f_lessmask(simd4f a, simd4f b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+inline float simd4f_x(simd4f a) { return _mm_cvtss_f32(a); }
+
+/* x*x' + y*y' + z*z' in every lane, added in that order like the scalar
+   code, so the results are the same */
+inline simd4f simd4f_dot3v(simd4f a, simd4f b)
+{
+  simd4f m = _mm_mul_ps(a, b);
+  simd4f y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+  simd4f z = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2));
+  simd4f d = _mm_add_ss(_mm_add_ss(m, y), z);
+  return _mm_shuffle_ps(d, d, _MM_SHUFFLE(0, 0, 0, 0));
+}
+inline float simd4f_dot3(simd4f a, simd4f b) { return _mm_cvtss_f32(simd4f_dot3v(a, b)); }
+inline simd4f simd4f_sqrt(simd4f a) { return _mm_sqrt_ps(a); }
+/* 1/sqrt(a) to about 12 bits, see fastmath.h for a full precision one */
+inline simd4f simd4f_rsqrt(simd4f a) { return _mm_rsqrt_ps(a); }
+
+/* The cross product of the xyz parts, w comes out as zero:
+   (a * b.yzx - a.yzx * b).yzx */
+inline simd4f simd4f_cross3(simd4f a, simd4f b)
+{
+  simd4f a1 = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+  simd4f b1 = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+  simd4f c = _mm_sub_ps(_mm_mul_ps(a, b1), _mm_mul_ps(a1, b));
+  return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+/* Transposes the 4x4 matrix with rows r0..r3 in place */
+inline void simd4f_transpose(simd4f& r0, simd4f& r1, simd4f& r2, simd4f& r3)
+{
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#elif defined(VECTOR_SIMD_NEON)
+
+typedef float32x4_t simd4f;
+
+inline simd4f simd4f_load(const float* p) { return vld1q_f32(p); }
+inline void simd4f_store(float* p, simd4f a) { vst1q_f32(p, a); }
+inline simd4f simd4f_set(float x, float y, float z, float w)
+{
+  float v[4] = {x, y, z, w};
+  return vld1q_f32(v);
+}
+inline simd4f simd4f_splat(float s) { return vdupq_n_f32(s); }
+inline simd4f simd4f_add(simd4f a, simd4f b) { return vaddq_f32(a, b); }
+inline simd4f simd4f_sub(simd4f a, simd4f b) { return vsubq_f32(a, b); }
+inline simd4f simd4f_mul(simd4f a, simd4f b) { return vmulq_f32(a, b); }
+inline simd4f simd4f_div(simd4f a, simd4f b) { return vdivq_f32(a, b); }
+inline simd4f simd4f_min(simd4f a, simd4f b) { return vminq_f32(a, b); }
+inline simd4f simd4f_max(simd4f a, simd4f b) { return vmaxq_f32(a, b); }
+inline int simd4f_lessmask(simd4f a, simd4f b)
+{
+  const uint32_t bits[4] = { 1, 2, 4, 8 };
+  uint32x4_t m = vandq_u32(vcltq_f32(a, b), vld1q_u32(bits));
+  return static_cast<int>(vaddvq_u32(m));
+}
+inline float simd4f_x(simd4f a) { return vgetq_lane_f32(a, 0); }
+
+inline float simd4f_dot3(simd4f a, simd4f b)
+{
+  simd4f m = vmulq_f32(a, b);
+  return (vgetq_lane_f32(m, 0) + vgetq_lane_f32(m, 1)) + vgetq_lane_f32(m, 2);
+}
+inline simd4f simd4f_dot3v(simd4f a, simd4f b) { return vdupq_n_f32(simd4f_dot3(a, b)); }
+inline simd4f simd4f_sqrt(simd4f a) { return vsqrtq_f32(a); }
+/* the 8-bit estimate with one refinement step, about 16 bits */
+inline simd4f simd4f_rsqrt(simd4f a)
+{
+  float32x4_t e = vrsqrteq_f32(a);
+  return vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(a, e), e));
+}
+
+inline simd4f simd4f_cross3(simd4f a, simd4f b)
+{
+  /* yzx and zxy rotations of the xyz part, w ends up zero */
+  float32x4_t a_yzx = vextq_f32(vextq_f32(a, a, 3), a, 2);
+  float32x4_t b_yzx = vextq_f32(vextq_f32(b, b, 3), b, 2);
+  float32x4_t c = vsubq_f32(vmulq_f32(a, b_yzx), vmulq_f32(a_yzx, b));
+  float32x4_t c_yzx = vextq_f32(vextq_f32(c, c, 3), c, 2);
+  return vsetq_lane_f32(0.0f, c_yzx, 3);
+}
+
+inline void simd4f_transpose(simd4f& r0, simd4f& r1, simd4f& r2, simd4f& r3)
+{
+  float32x4_t t0 = vzip1q_f32(r0, r2), t1 = vzip2q_f32(r0, r2);
+  float32x4_t t2 = vzip1q_f32(r1, r3), t3 = vzip2q_f32(r1, r3);
+  r0 = vzip1q_f32(t0, t2);
+  r1 = vzip2q_f32(t0, t2);
+  r2 = vzip1q_f32(t1, t3);
+  r3 = vzip2q_f32(t1, t3);
+}
+
+#else
+
+struct simd4f
+{
+  float v[4];
+};
+
+inline simd4f simd4f_load(const float* p)
+{
+  simd4f r = {{p[0], p[1], p[2], p[3]}};
+  return r;
+}
+inline void simd4f_store(float* p, simd4f a)
+{
+  p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3];
+}
+inline simd4f simd4f_set(float x, float y, float z, float w)
+{
+  simd4f r = {{x, y, z, w}};
+  return r;
+}
+inline simd4f simd4f_splat(float s) { return simd4f_set(s, s, s, s); }
+inline simd4f simd4f_add(simd4f a, simd4f b)
+{
+  return simd4f_set(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]);
+}
+inline simd4f simd4f_sub(simd4f a, simd4f b)
+{
+  return simd4f_set(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]);
+}
+inline simd4f simd4f_mul(simd4f a, simd4f b)
+{
+  return simd4f_set(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]);
+}
+inline simd4f simd4f_div(simd4f a, simd4f b)
+{
+  return simd4f_set(a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]);
+}
+inline simd4f simd4f_min(simd4f a, simd4f b)
+{
+  return simd4f_set(a.v[0] < b.v[0] ? a.v[0] : b.v[0], a.v[1] < b.v[1] ? a.v[1] : b.v[1],
+		    a.v[2] < b.v[2] ? a.v[2] : b.v[2], a.v[3] < b.v[3] ? a.v[3] : b.v[3]);
+}
+inline simd4f simd4f_max(simd4f a, simd4f b)
+{
+  return simd4f_set(a.v[0] > b.v[0] ? a.v[0] : b.v[0], a.v[1] > b.v[1] ? a.v[1] : b.v[1],
+		    a.v[2] > b.v[2] ? a.v[2] : b.v[2], a.v[3] > b.v[3] ? a.v[3] : b.v[3]);
+}
+inline int simd4f_lessmask(simd4f a, simd4f b)
+{
+  return (a.v[0] < b.v[0] ? 1 : 0) | (a.v[1] < b.v[1] ? 2 : 0) | (a.v[2] < b.v[2] ? 4 : 0) | (a.v[3] < b.v[3] ? 8 : 0);
+}
+inline float simd4f_x(simd4f a) { return a.v[0]; }
+
+inline float simd4f_dot3(simd4f a, simd4f b)
+{
+  return a.v[0]*b.v[0] + a.v[1]*b.v[1] + a.v[2]*b.v[2];
+}
+inline simd4f simd4f_dot3v(simd4f a, simd4f b) { return simd4f_splat(simd4f_dot3(a, b)); }
+inline simd4f simd4f_sqrt(simd4f a)
+{
+  return simd4f_set(std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3]));
+}
+inline simd4f simd4f_rsqrt(simd4f a)
+{
+  return simd4f_div(simd4f_splat(1.0f), simd4f_sqrt(a));
+}
+
+inline simd4f simd4f_cross3(simd4f a, simd4f b)
+{
+  return simd4f_set(a.v[1]*b.v[2] - a.v[2]*b.v[1],
+		    a.v[2]*b.v[0] - a.v[0]*b.v[2],
+		    a.v[0]*b.v[1] - a.v[1]*b.v[0],
+		    0.0f);
+}
+
+inline void simd4f_transpose(simd4f& r0, simd4f& r1, simd4f& r2, simd4f& r3)
+{
+  simd4f t0 = simd4f_set(r0.v[0], r1.v[0], r2.v[0], r3.v[0]);
+  simd4f t1 = simd4f_set(r0.v[1], r1.v[1], r2.v[1], r3.v[1]);
+  simd4f t2 = simd4f_set(r0.v[2], r1.v[2], r2.v[2], r3.v[2]);
+  simd4f t3 = simd4f_set(r0.v[3], r1.v[3], r2.v[3], r3.v[3]);
+  r0 = t0; r1 = t1; r2 = t2; r3 = t3;
+}
+
+#endif
+
+/* The widest float pack the compiler was told it may use: 16 lanes with
+   AVX-512 (-mavx512f), 8 with AVX (-mavx, -mavx2), 4 with SSE or NEON,
+   and a single float otherwise. Used by the structure-of-arrays kernels
+   (vectorarray.h), where every lane is a different vector. simdf_madd is
+   a fused multiply-add when FMA is available, so results can differ from
+   the scalar code in the last bit. */
+#if defined(VECTOR_SIMD_SSE) && defined(__AVX512F__)
+
+#include <immintrin.h>
+#define SIMDF_WIDTH 16
+typedef __m512 simdf;
+
+/* Where an intrinsic has a zero-masked form, that one is used: the plain
+   forms of sqrt, rsqrt14, min and max read an undefined register in GCC 12's
+   headers, which -Wall reports as uninitialized in every caller */
+inline simdf simdf_load(const float* p) { return _mm512_load_ps(p); }
+inline simdf simdf_loadu(const float* p) { return _mm512_loadu_ps(p); }
+inline void simdf_store(float* p, simdf a) { _mm512_store_ps(p, a); }
+inline void simdf_storeu(float* p, simdf a) { _mm512_storeu_ps(p, a); }
+inline simdf simdf_splat(float s) { return _mm512_set1_ps(s); }
+inline simdf simdf_add(simdf a, simdf b) { return _mm512_add_ps(a, b); }
+inline simdf simdf_sub(simdf a, simdf b) { return _mm512_sub_ps(a, b); }
+inline simdf simdf_mul(simdf a, simdf b) { return _mm512_mul_ps(a, b); }
+inline simdf simdf_div(simdf a, simdf b) { return _mm512_div_ps(a, b); }
+inline simdf simdf_madd(simdf a, simdf b, simdf c) { return _mm512_fmadd_ps(a, b, c); }
+inline simdf simdf_sqrt(simdf a) { return _mm512_maskz_sqrt_ps(0xFFFF, a); }
+/* estimates of 1/sqrt(a), 12 bits or better */
+inline simdf simdf_rsqrt(simdf a) { return _mm512_maskz_rsqrt14_ps(0xFFFF, a); }
+/* a where b >= limit, zero elsewhere */
+inline simdf simdf_zero_below(simdf a, simdf b, float limit)
+{
+  return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(b, _mm512_set1_ps(limit), _CMP_GE_OQ), a);
+}
+inline simdf simdf_min(simdf a, simdf b) { return _mm512_maskz_min_ps(0xFFFF, a, b); }
+inline simdf simdf_max(simdf a, simdf b) { return _mm512_maskz_max_ps(0xFFFF, a, b); }
+/* bit i set where lane i of a is less than or equal to lane i of b, clear
+   where either is NaN */
+inline int simdf_lessequalmask(simdf a, simdf b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+
+#elif defined(VECTOR_SIMD_SSE) && defined(__AVX__)
+
+#include <immintrin.h>
+#define SIMDF_WIDTH 8
+typedef __m256 simdf;
+
+inline simdf simdf_load(const float* p) { return _mm256_load_ps(p); }
+inline simdf simdf_loadu(const float* p) { return _mm256_loadu_ps(p); }
+inline void simdf_store(float* p, simdf a) { _mm256_store_ps(p, a); }
+inline void simdf_storeu(float* p, simdf a) { _mm256_storeu_ps(p, a); }
+inline simdf simdf_splat(float s) { return _mm256_set1_ps(s); }
+inline simdf simdf_add(simdf a, simdf b) { return _mm256_add_ps(a, b); }
+inline simdf simdf_sub(simdf a, simdf b) { return _mm256_sub_ps(a, b); }
+inline simdf simdf_mul(simdf a, simdf b) { return _mm256_mul_ps(a, b); }
+inline simdf simdf_div(simdf a, simdf b) { return _mm256_div_ps(a, b); }
+#if defined(__FMA__)
+inline simdf simdf_madd(simdf a, simdf b, simdf c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+inline simdf simdf_madd(simdf a, simdf b, simdf c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+inline simdf simdf_sqrt(simdf a) { return _mm256_sqrt_ps(a); }
+inline simdf simdf_rsqrt(simdf a) { return _mm256_rsqrt_ps(a); }
+inline simdf simdf_zero_below(simdf a, simdf b, float limit)
+{
+  return _mm256_and_ps(_mm256_cmp_ps(b, _mm256_set1_ps(limit), _CMP_GE_OQ), a);
+}
+inline simdf simdf_min(simdf a, simdf b) { return _mm256_min_ps(a, b); }
+inline simdf simdf_max(simdf a, simdf b) { return _mm256_max_ps(a, b); }
+inline int simdf_lessequalmask(simdf a, simdf b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+
+#elif defined(VECTOR_SIMD_SSE) || defined(VECTOR_SIMD_NEON)
+
+#define SIMDF_WIDTH 4
+typedef simd4f simdf;
+
+inline simdf simdf_load(const float* p) { return simd4f_load(p); }
+inline void simdf_store(float* p, simdf a) { simd4f_store(p, a); }
+inline simdf simdf_splat(float s) { return simd4f_splat(s); }
+inline simdf simdf_add(simdf a, simdf b) { return simd4f_add(a, b); }
+inline simdf simdf_sub(simdf a, simdf b) { return simd4f_sub(a, b); }
+inline simdf simdf_mul(simdf a, simdf b) { return simd4f_mul(a, b); }
+inline simdf simdf_div(simdf a, simdf b) { return simd4f_div(a, b); }
+inline simdf simdf_madd(simdf a, simdf b, simdf c) { return simd4f_add(simd4f_mul(a, b), c); }
+inline simdf simdf_sqrt(simdf a) { return simd4f_sqrt(a); }
+inline simdf simdf_rsqrt(simdf a) { return simd4f_rsqrt(a); }
+inline simdf simdf_min(simdf a, simdf b) { return simd4f_min(a, b); }
+inline simdf simdf_max(simdf a, simdf b) { return simd4f_max(a, b); }
+#if defined(VECTOR_SIMD_SSE)
+inline simdf simdf_loadu(const float* p) { return _mm_loadu_ps(p); }
+inline void simdf_storeu(float* p, simdf a) { _mm_storeu_ps(p, a); }
+inline simdf simdf_zero_below(simdf a, simdf b, float limit)
+{
+  return _mm_and_ps(_mm_cmpge_ps(b, _mm_set1_ps(limit)), a);
+}
+inline int simdf_lessequalmask(simdf a, simdf b) { return _mm_movemask_ps(_mm_cmple_ps(a, b)); }
+#else
+inline simdf simdf_loadu(const float* p) { return vld1q_f32(p); }
+inline void simdf_storeu(float* p, simdf a) { vst1q_f32(p, a); }
+inline simdf simdf_zero_below(simdf a, simdf b, float limit)
+{
+  uint32x4_t keep = vcgeq_f32(b, vdupq_n_f32(limit));
+  return vreinterpretq_f32_u32(vandq_u32(keep, vreinterpretq_u32_f32(a)));
+}
+inline int simdf_lessequalmask(simdf a, simdf b)
+{
+  const uint32_t bits[4] = { 1, 2, 4, 8 };
+  uint32x4_t m = vandq_u32(vcleq_f32(a, b), vld1q_u32(bits));
+  return static_cast<int>(vaddvq_u32(m));
+}
+#endif
+
+#else
+
+#define SIMDF_WIDTH 1
+typedef float simdf;
+
+inline simdf simdf_load(const float* p) { return *p; }
+inline simdf simdf_loadu(const float* p) { return *p; }
+inline void simdf_store(float* p, simdf a) { *p = a; }
+inline void simdf_storeu(float* p, simdf a) { *p = a; }
+inline simdf simdf_splat(float s) { return s; }
+inline simdf simdf_add(simdf a, simdf b) { return a + b; }
+inline simdf simdf_sub(simdf a, simdf b) { return a - b; }
+inline simdf simdf_mul(simdf a, simdf b) { return a * b; }
+inline simdf simdf_div(simdf a, simdf b) { return a / b; }
+inline simdf simdf_madd(simdf a, simdf b, simdf c) { return a * b + c; }
+inline simdf simdf_sqrt(simdf a) { return std::sqrt(a); }
+inline simdf simdf_rsqrt(simdf a) { return 1.0f / std::sqrt(a); }
+inline simdf simdf_zero_below(simdf a, simdf b, float limit) { return b >= limit ? a : 0.0f; }
+inline simdf simdf_min(simdf a, simdf b) { return a < b ? a : b; }
+inline simdf simdf_max(simdf a, simdf b) { return a > b ? a : b; }
+inline int simdf_lessequalmask(simdf a, simdf b) { return a <= b ? 1 : 0; }
+
+#endif
+
+/* Memory aligned for any of the packs above, and for cache lines */
+#define SIMD_ALIGNMENT 64
+
+inline void* simd_alloc(size_t bytes)
+{
+#if defined(_MSC_VER)
+  return _aligned_malloc(bytes ? bytes : 1, SIMD_ALIGNMENT);
+#else
+  void* p = 0;
+  if(posix_memalign(&p, SIMD_ALIGNMENT, bytes ? bytes : 1) != 0)
+    return 0;
+  return p;
+#endif
+}
+
+inline void simd_free(void* p)
+{
+#if defined(_MSC_VER)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+/* The xyz part scaled to unit length, or zero if it is too short to tell
+   its direction. w is divided along. */
+inline simd4f simd4f_unit3(simd4f a)
+{
+  simd4f len = simd4f_sqrt(simd4f_dot3v(a, a));
+  if(simd4f_x(len) < 1e-8f)
+    return simd4f_splat(0.0f);
+  return simd4f_div(a, len);
+}
+
+inline float simd4f_length3(simd4f a)
+{
+  return simd4f_x(simd4f_sqrt(simd4f_dot3v(a, a)));
+}
+
+#endif
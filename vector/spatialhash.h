@@ -0,0 +1,355 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SPATIALHASH_H_GUARD
+#define SPATIALHASH_H_GUARD
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+#include "vector2.h"
+#include "vector3.h"
+#include "../threadpool/threadpool.hpp"
+
+template<int N> struct SpatialHashPoint;
+template<> struct SpatialHashPoint<2>
+{
+  typedef Vector2f Type;
+  static float coord(const Type& p, int axis) { return axis ? p.y : p.x; }
+};
+template<> struct SpatialHashPoint<3>
+{
+  typedef Vector3f Type;
+  static float coord(const Type& p, int axis) { return axis == 0 ? p.x : (axis == 1 ? p.y : p.z); }
+};
+
+/* Broadphase for points that all move every frame: a uniform grid of
+   cubes (squares in 2D) of side cellSize, hashed into a table with at
+   least as many buckets as there are points, so that only the cells that
+   hold points take memory. Rebuilding is O(n): the bucket of every point
+   is found, and the points are sorted by bucket with a stable radix sort
+   (11 bits per pass, two passes up to 2M points), so each bucket ends up
+   contiguous in points(). The ThreadPool build sorts the same way in
+   chunks and gives the same result. The table and the sort buffers are
+   kept between builds, so rebuilding a set of the same size doesn't
+   allocate.
+
+   A query within radius r visits the buckets of the cells overlapping the
+   sphere's bounding box and checks the distance of every point in them;
+   with cellSize about r that is 27 cells in 3D (9 in 2D). Rows of cells
+   along x share a run of buckets, so that is 9 runs of memory (3 in 2D),
+   mostly the same ones for the next point in points(). The result is a near
+   O(n) neighbour search for the whole set, where it was O(n^2) with
+   distance() on every pair. Points are reported by the index they had in
+   the array given to build. */
+template<int N> class SpatialHash
+{
+public:
+  typedef typename SpatialHashPoint<N>::Type Point;
+
+  SpatialHash() : cellSize_(1.0f), invCell(1.0f), mask(0){}
+
+  void build(const Point* points, size_t count, float cellSize)
+  {
+    buildHash(0, points, count, cellSize);
+  }
+  void build(const std::vector<Point>& points, float cellSize)
+  {
+    buildHash(0, points.empty() ? 0 : &points[0], points.size(), cellSize);
+  }
+  void build(ThreadPool& pool, const Point* points, size_t count, float cellSize)
+  {
+    buildHash(&pool, points, count, cellSize);
+  }
+  void build(ThreadPool& pool, const std::vector<Point>& points, float cellSize)
+  {
+    buildHash(&pool, points.empty() ? 0 : &points[0], points.size(), cellSize);
+  }
+
+  void clear()
+  {
+    sorted.clear();
+    index.clear();
+    starts.assign(2, 0);
+    mask = 0;
+  }
+
+  size_t size() const { return sorted.size(); }
+  float cellSize() const { return cellSize_; }
+  /* The points sorted by bucket, and the index each had in build */
+  const std::vector<Point>& points() const { return sorted; }
+  const std::vector<int>& indices() const { return index; }
+
+  /* Calls f(i, d2) for every point i within radius of p, where d2 is its
+     squared distance to p, each point once */
+  template<class F>
+  void query(const Point& p, float radius, F f) const
+  {
+    if(sorted.empty())
+      return;
+    int lo[N], hi[N];
+    for(int a=0; a<N; ++a){
+      lo[a] = cellOf(SpatialHashPoint<N>::coord(p, a) - radius);
+      hi[a] = cellOf(SpatialHashPoint<N>::coord(p, a) + radius);
+    }
+    float r2 = radius * radius;
+    size_t length = static_cast<size_t>(static_cast<int64_t>(hi[0]) - lo[0]) + 1;
+    size_t rows = 1;
+    for(int a=1; a<N && rows<=mask; ++a)
+      rows *= static_cast<size_t>(static_cast<int64_t>(hi[a]) - lo[a]) + 1;
+    if(length > mask || rows > mask){
+      /* the box covers more cells than there are buckets */
+      scanBuckets(0, mask + 1, p, r2, f);
+      return;
+    }
+    /* The bucket ranges of the rows, which may wrap around the end of the
+       table, and may overlap where rows share buckets: sorted and merged
+       so that every bucket is scanned once */
+    Range local[64];
+    std::vector<Range> more;
+    Range* ranges = local;
+    if(2 * rows > 64){
+      more.resize(2 * rows);
+      ranges = &more[0];
+    }
+    size_t count = 0;
+    int c[N];
+    for(int a=0; a<N; ++a)
+      c[a] = lo[a];
+    for(size_t k=0; k<rows; ++k){
+      uint32_t first = bucketOfCell(c);
+      uint32_t last = first + static_cast<uint32_t>(length);
+      if(last > mask + 1){
+	ranges[count].first = 0;
+	ranges[count++].last = last - (mask + 1);
+	last = mask + 1;
+      }
+      ranges[count].first = first;
+      ranges[count++].last = last;
+      for(int a=1; a<N && ++c[a] > hi[a]; ++a)
+	c[a] = lo[a];
+    }
+    std::sort(ranges, ranges + count);
+    uint32_t first = ranges[0].first, last = ranges[0].last;
+    for(size_t k=1; k<count; ++k){
+      if(ranges[k].first > last){
+	scanBuckets(first, last, p, r2, f);
+	first = ranges[k].first;
+      }
+      last = std::max(last, ranges[k].last);
+    }
+    scanBuckets(first, last, p, r2, f);
+  }
+
+  /* Calls f(i, j, d2) once for every pair of points closer than radius,
+     with i < j */
+  template<class F>
+  void forEachPair(float radius, F f) const
+  {
+    pairRange(0, sorted.size(), radius, f);
+  }
+
+  /* The same with the points split over the pool, so f must be safe to
+     call from several threads at once */
+  template<class F>
+  void forEachPair(ThreadPool& pool, float radius, F f) const
+  {
+    pool.ParallelFor(0, sorted.size(), 1024, [this, radius, &f](size_t first, size_t last) {
+	pairRange(first, last, radius, f);
+      });
+  }
+
+private:
+  static const int RADIX_BITS = 11;
+  static const size_t RADIX = size_t(1) << RADIX_BITS;
+  static const size_t CHUNK = 32768;
+
+  float cellSize_, invCell;
+  uint32_t mask;                 /* buckets - 1, a power of two less one */
+  std::vector<Point> sorted;
+  std::vector<int> index;
+  /* the points of bucket b are sorted[starts[b], starts[b + 1]) */
+  std::vector<int> starts;
+  /* sort buffers */
+  std::vector<uint32_t> keys, keyTemp;
+  std::vector<int> indexTemp;
+  std::vector<size_t> histogram;
+
+  struct Range
+  {
+    uint32_t first, last;
+    bool operator<(const Range& r) const { return first < r.first; }
+  };
+
+  int cellOf(float v) const
+  {
+    float c = std::floor(v * invCell);
+    c = std::max(std::min(c, 1073741824.0f), -1073741824.0f);
+    return static_cast<int>(c);
+  }
+
+  /* Cells next to each other along x go in consecutive buckets, so a
+     query scans a few runs of buckets instead of every cell on its own.
+     The rows are spread over the table by a hash of y (and z). */
+  uint32_t bucketOfCell(const int* c) const
+  {
+    static const uint32_t primes[2] = { 19349663u, 83492791u };
+    uint32_t h = 0;
+    for(int a=1; a<N; ++a)
+      h ^= static_cast<uint32_t>(c[a]) * primes[a - 1];
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return (h + static_cast<uint32_t>(c[0])) & mask;
+  }
+
+  uint32_t bucketOf(const Point& p) const
+  {
+    int c[N];
+    for(int a=0; a<N; ++a)
+      c[a] = cellOf(SpatialHashPoint<N>::coord(p, a));
+    return bucketOfCell(c);
+  }
+
+  template<class F>
+  void scanBuckets(uint32_t first, uint32_t last, const Point& p, float r2, F& f) const
+  {
+    for(int k=starts[first]; k<starts[last]; ++k){
+      Point d = sorted[k] - p;
+      float d2 = dot(d, d);
+      if(d2 <= r2)
+	f(index[k], d2);
+    }
+  }
+
+  template<class F>
+  void pairRange(size_t first, size_t last, float radius, F& f) const
+  {
+    for(size_t s=first; s<last; ++s){
+      int i = index[s];
+      query(sorted[s], radius, [i, &f](int j, float d2) {
+	  if(i < j)
+	    f(i, j, d2);
+	});
+    }
+  }
+
+  /* f(chunk, first, last) over [0, count), in CHUNK sized pieces on the
+     pool, or as one piece */
+  template<class F>
+  static void forChunks(ThreadPool* pool, size_t count, F f)
+  {
+    if(pool && count > CHUNK)
+      pool->ParallelFor(0, count, CHUNK, [&f](size_t first, size_t last) {
+	  f(first / CHUNK, first, last);
+	});
+    else
+      f(0, 0, count);
+  }
+
+  void buildHash(ThreadPool* pool, const Point* points, size_t count, float cellSize)
+  {
+    cellSize_ = cellSize;
+    invCell = 1.0f / cellSize;
+    uint32_t buckets = 1;
+    int bits = 0;
+    while(buckets < count && bits < 31){
+      buckets <<= 1;
+      ++bits;
+    }
+    mask = buckets - 1;
+    keys.resize(count);
+    index.resize(count);
+    forChunks(pool, count, [this, points](size_t, size_t first, size_t last) {
+	for(size_t i=first; i<last; ++i){
+	  keys[i] = bucketOf(points[i]);
+	  index[i] = static_cast<int>(i);
+	}
+      });
+    for(int shift=0; shift<bits; shift+=RADIX_BITS)
+      radixPass(pool, shift);
+
+    sorted.resize(count);
+    forChunks(pool, count, [this, points](size_t, size_t first, size_t last) {
+	for(size_t i=first; i<last; ++i)
+	  sorted[i] = points[index[i]];
+      });
+    /* the start of every bucket up to the key of point i is i */
+    starts.resize(static_cast<size_t>(buckets) + 1);
+    forChunks(pool, count, [this](size_t, size_t first, size_t last) {
+	for(size_t i=first; i<last; ++i){
+	  if(i > 0 && keys[i] == keys[i - 1])
+	    continue;
+	  for(uint32_t b=(i ? keys[i - 1] + 1 : 0); b<=keys[i]; ++b)
+	    starts[b] = static_cast<int>(i);
+	}
+      });
+    uint32_t from = count ? keys[count - 1] + 1 : 0;
+    for(size_t b=from; b<=buckets; ++b)
+      starts[b] = static_cast<int>(count);
+  }
+
+  /* One stable counting sort of keys and index on RADIX_BITS of the key */
+  void radixPass(ThreadPool* pool, int shift)
+  {
+    size_t count = keys.size();
+    size_t chunks = (pool && count > CHUNK) ? (count + CHUNK - 1) / CHUNK : 1;
+    histogram.assign(chunks * RADIX, 0);
+    forChunks(pool, count, [this, shift](size_t chunk, size_t first, size_t last) {
+	size_t* h = &histogram[chunk * RADIX];
+	for(size_t i=first; i<last; ++i)
+	  ++h[keys[i] >> shift & (RADIX - 1)];
+      });
+    size_t offset = 0;
+    for(size_t d=0; d<RADIX; ++d){
+      for(size_t c=0; c<chunks; ++c){
+	size_t n = histogram[c * RADIX + d];
+	histogram[c * RADIX + d] = offset;
+	offset += n;
+      }
+    }
+    keyTemp.resize(count);
+    indexTemp.resize(count);
+    forChunks(pool, count, [this, shift](size_t chunk, size_t first, size_t last) {
+	size_t* h = &histogram[chunk * RADIX];
+	for(size_t i=first; i<last; ++i){
+	  size_t to = h[keys[i] >> shift & (RADIX - 1)]++;
+	  keyTemp[to] = keys[i];
+	  indexTemp[to] = index[i];
+	}
+      });
+    keys.swap(keyTemp);
+    index.swap(indexTemp);
+  }
+};
+
+typedef SpatialHash<2> SpatialHash2f;
+typedef SpatialHash<3> SpatialHash3f;
+
+#endif
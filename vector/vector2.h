@@ -62,32 +62,38 @@ template<class T> struct Vector2
 	
   Vector2<T>& operator+=(const Vector2<T>& v)
   {
-    *this = *this + v;
+    x += v.x;
+    y += v.y;
     return *this;
   }
   Vector2<T>& operator-=(const Vector2<T>& v)
   {
-    *this = *this - v;
+    x -= v.x;
+    y -= v.y;
     return *this;
   }
   Vector2<T>& operator+=(T s)
   {
-    *this = *this + s;
+    x += s;
+    y += s;
     return *this;
   }
   Vector2<T>& operator-=(T s)
   {
-    *this = *this - s;
+    x -= s;
+    y -= s;
     return *this;
   }
   Vector2<T>& operator*=(T s)
   {
-    *this = *this * s;
+    x *= s;
+    y *= s;
     return *this;
   }
   Vector2<T>& operator/=(T s)
   {
-    *this = *this / s;
+    x /= s;
+    y /= s;
     return *this;
   }
 
@@ -28,6 +28,7 @@
 #ifndef VECTOR3_H_GUARD
 #define VECTOR3_H_GUARD
 #include <cmath>
+#include "simd.h"
 
 
 template<class T>
@@ -66,33 +67,45 @@ struct Vector3
 
   Vector3<T>& operator+=(const Vector3<T>& v)
   {
-    *this = *this + v;
+    x += v.x;
+    y += v.y;
+    z += v.z;
     return *this;
   }
   Vector3<T>& operator-=(const Vector3<T>& v)
   {
-    *this = *this - v;
+    x -= v.x;
+    y -= v.y;
+    z -= v.z;
     return *this;
   }
 
   Vector3<T>& operator+=(const T& v)
   {
-    *this = *this + v;
+    x += v;
+    y += v;
+    z += v;
     return *this;
   }
   Vector3<T>& operator-=(const T& v)
   {
-    *this = *this - v;
+    x -= v;
+    y -= v;
+    z -= v;
     return *this;
   }
   Vector3<T>& operator*=(const T& v)
   {
-    *this = *this * v;
+    x *= v;
+    y *= v;
+    z *= v;
     return *this;
   }
   Vector3<T>& operator/=(const T& v)
   {
-    *this = *this / v;
+    x /= v;
+    y /= v;
+    z /= v;
     return *this;
   }
 
@@ -134,6 +147,103 @@ inline Vector3<T> cross(const Vector3<T>& v1, const Vector3<T>& v2)
 		    );
 }
 
+/* A Vector3f padded to 16 bytes and aligned, so it fits in one SIMD
+   register (see simd.h) and its operators are single packed instructions.
+   Use it where the math is hot, and Vector3f where memory is tight: it
+   converts to and from Vector3f. pad is not used. */
+struct alignas(16) PaddedVector3f
+{
+  float x,y,z;
+  float pad;
+
+  PaddedVector3f() : x(0.0f), y(0.0f), z(0.0f), pad(0.0f){}
+  PaddedVector3f(float a, float b, float c) : x(a), y(b), z(c), pad(0.0f){}
+  PaddedVector3f(const Vector3<float>& v) : x(v.x), y(v.y), z(v.z), pad(0.0f){}
+  explicit PaddedVector3f(simd4f v) { simd4f_store(&x, v); }
+
+  operator Vector3<float>() const { return Vector3<float>(x, y, z); }
+  simd4f simd() const { return simd4f_load(&x); }
+
+  PaddedVector3f operator+(const PaddedVector3f& v) const
+  {
+    return PaddedVector3f(simd4f_add(simd(), v.simd()));
+  }
+  PaddedVector3f operator-(const PaddedVector3f& v) const
+  {
+    return PaddedVector3f(simd4f_sub(simd(), v.simd()));
+  }
+  PaddedVector3f operator+(float v) const
+  {
+    return PaddedVector3f(simd4f_add(simd(), simd4f_splat(v)));
+  }
+  PaddedVector3f operator-(float v) const
+  {
+    return PaddedVector3f(simd4f_sub(simd(), simd4f_splat(v)));
+  }
+  PaddedVector3f operator*(float v) const
+  {
+    return PaddedVector3f(simd4f_mul(simd(), simd4f_splat(v)));
+  }
+  PaddedVector3f operator/(float v) const
+  {
+    return PaddedVector3f(simd4f_div(simd(), simd4f_splat(v)));
+  }
+
+  PaddedVector3f& operator+=(const PaddedVector3f& v)
+  {
+    simd4f_store(&x, simd4f_add(simd(), v.simd()));
+    return *this;
+  }
+  PaddedVector3f& operator-=(const PaddedVector3f& v)
+  {
+    simd4f_store(&x, simd4f_sub(simd(), v.simd()));
+    return *this;
+  }
+  PaddedVector3f& operator+=(float v)
+  {
+    simd4f_store(&x, simd4f_add(simd(), simd4f_splat(v)));
+    return *this;
+  }
+  PaddedVector3f& operator-=(float v)
+  {
+    simd4f_store(&x, simd4f_sub(simd(), simd4f_splat(v)));
+    return *this;
+  }
+  PaddedVector3f& operator*=(float v)
+  {
+    simd4f_store(&x, simd4f_mul(simd(), simd4f_splat(v)));
+    return *this;
+  }
+  PaddedVector3f& operator/=(float v)
+  {
+    simd4f_store(&x, simd4f_div(simd(), simd4f_splat(v)));
+    return *this;
+  }
+
+  float length() const
+  {
+    return simd4f_length3(simd());
+  }
+  PaddedVector3f unit() const
+  {
+    return PaddedVector3f(simd4f_unit3(simd()));
+  }
+  void normalize()
+  {
+    *this = unit();
+  }
+};
+
+inline float dot(const PaddedVector3f& v1, const PaddedVector3f& v2)
+{
+  return simd4f_dot3(v1.simd(), v2.simd());
+}
+
+inline PaddedVector3f cross(const PaddedVector3f& v1, const PaddedVector3f& v2)
+{
+  return PaddedVector3f(simd4f_cross3(v1.simd(), v2.simd()));
+}
+
 typedef Vector3<int> Vector3i;
 typedef Vector3<float> Vector3f;
 typedef Vector3<double> Vector3d;
@@ -29,8 +29,12 @@
 #define VECTOR4_H_GUARD
 #include <cmath>
 
+#include "simd.h"
 #include "vector3.h"
 
+/* A Vector3 with a w component. The arithmetic operators work on all four
+   components, while length, unit, dot and cross use x, y and z only, like
+   they do for the Vector3 it derives from. */
 template<class T>
 struct Vector4 : public Vector3<T>
 {
@@ -38,12 +42,200 @@ struct Vector4 : public Vector3<T>
   Vector4() : Vector3<T>(), w(T(1.0f)){}
   Vector4(T a, T b, T c, T d = 1.0f) : Vector3<T>(a,b,c), w(d){}
   Vector4(const Vector3<T>& v, T d = 1.0f) : Vector3<T>(v), w(d){}
+
+  using Vector3<T>::operator+;
+  using Vector3<T>::operator-;
+  using Vector3<T>::operator+=;
+  using Vector3<T>::operator-=;
+
+  Vector4<T> operator+(const Vector4<T>& v) const
+  {
+    return Vector4<T>(this->x + v.x, this->y + v.y, this->z + v.z, w + v.w);
+  }
+  Vector4<T> operator-(const Vector4<T>& v) const
+  {
+    return Vector4<T>(this->x - v.x, this->y - v.y, this->z - v.z, w - v.w);
+  }
+  Vector4<T> operator+(const T& v) const
+  {
+    return Vector4<T>(this->x + v, this->y + v, this->z + v, w + v);
+  }
+  Vector4<T> operator-(const T& v) const
+  {
+    return Vector4<T>(this->x - v, this->y - v, this->z - v, w - v);
+  }
+  Vector4<T> operator*(const T& v) const
+  {
+    return Vector4<T>(this->x * v, this->y * v, this->z * v, w * v);
+  }
+  Vector4<T> operator/(const T& v) const
+  {
+    return Vector4<T>(this->x / v, this->y / v, this->z / v, w / v);
+  }
+
+  Vector4<T>& operator+=(const Vector4<T>& v)
+  {
+    this->x += v.x;
+    this->y += v.y;
+    this->z += v.z;
+    w += v.w;
+    return *this;
+  }
+  Vector4<T>& operator-=(const Vector4<T>& v)
+  {
+    this->x -= v.x;
+    this->y -= v.y;
+    this->z -= v.z;
+    w -= v.w;
+    return *this;
+  }
+  Vector4<T>& operator+=(const T& v)
+  {
+    this->x += v;
+    this->y += v;
+    this->z += v;
+    w += v;
+    return *this;
+  }
+  Vector4<T>& operator-=(const T& v)
+  {
+    this->x -= v;
+    this->y -= v;
+    this->z -= v;
+    w -= v;
+    return *this;
+  }
+  Vector4<T>& operator*=(const T& v)
+  {
+    this->x *= v;
+    this->y *= v;
+    this->z *= v;
+    w *= v;
+    return *this;
+  }
+  Vector4<T>& operator/=(const T& v)
+  {
+    this->x /= v;
+    this->y /= v;
+    this->z /= v;
+    w /= v;
+    return *this;
+  }
+
   bool operator<(const Vector4<T>& v) const
   {
 	return this->z > v.z;
   }
 };
 
+/* Vector4f is one aligned 16-byte SIMD register (see simd.h), and its
+   operators are single packed instructions. The layout and the members
+   are the same as for the other Vector4 types. */
+template<>
+struct alignas(16) Vector4<float> : public Vector3<float>
+{
+  float w;
+  Vector4() : Vector3<float>(), w(1.0f){}
+  Vector4(float a, float b, float c, float d = 1.0f) : Vector3<float>(a,b,c), w(d){}
+  Vector4(const Vector3<float>& v, float d = 1.0f) : Vector3<float>(v), w(d){}
+  explicit Vector4(simd4f v) { simd4f_store(&x, v); }
+
+  simd4f simd() const { return simd4f_load(&x); }
+
+  using Vector3<float>::operator+;
+  using Vector3<float>::operator-;
+  using Vector3<float>::operator+=;
+  using Vector3<float>::operator-=;
+
+  Vector4<float> operator+(const Vector4<float>& v) const
+  {
+    return Vector4<float>(simd4f_add(simd(), v.simd()));
+  }
+  Vector4<float> operator-(const Vector4<float>& v) const
+  {
+    return Vector4<float>(simd4f_sub(simd(), v.simd()));
+  }
+  Vector4<float> operator+(const float& v) const
+  {
+    return Vector4<float>(simd4f_add(simd(), simd4f_splat(v)));
+  }
+  Vector4<float> operator-(const float& v) const
+  {
+    return Vector4<float>(simd4f_sub(simd(), simd4f_splat(v)));
+  }
+  Vector4<float> operator*(const float& v) const
+  {
+    return Vector4<float>(simd4f_mul(simd(), simd4f_splat(v)));
+  }
+  Vector4<float> operator/(const float& v) const
+  {
+    return Vector4<float>(simd4f_div(simd(), simd4f_splat(v)));
+  }
+
+  Vector4<float>& operator+=(const Vector4<float>& v)
+  {
+    simd4f_store(&x, simd4f_add(simd(), v.simd()));
+    return *this;
+  }
+  Vector4<float>& operator-=(const Vector4<float>& v)
+  {
+    simd4f_store(&x, simd4f_sub(simd(), v.simd()));
+    return *this;
+  }
+  Vector4<float>& operator+=(const float& v)
+  {
+    simd4f_store(&x, simd4f_add(simd(), simd4f_splat(v)));
+    return *this;
+  }
+  Vector4<float>& operator-=(const float& v)
+  {
+    simd4f_store(&x, simd4f_sub(simd(), simd4f_splat(v)));
+    return *this;
+  }
+  Vector4<float>& operator*=(const float& v)
+  {
+    simd4f_store(&x, simd4f_mul(simd(), simd4f_splat(v)));
+    return *this;
+  }
+  Vector4<float>& operator/=(const float& v)
+  {
+    simd4f_store(&x, simd4f_div(simd(), simd4f_splat(v)));
+    return *this;
+  }
+
+  bool operator<(const Vector4<float>& v) const
+  {
+	return z > v.z;
+  }
+
+  float length() const
+  {
+    return simd4f_length3(simd());
+  }
+  Vector3<float> unit() const
+  {
+    Vector4<float> u(simd4f_unit3(simd()));
+    return Vector3<float>(u.x, u.y, u.z);
+  }
+  void normalize()
+  {
+    float keep = w;
+    simd4f_store(&x, simd4f_unit3(simd()));
+    w = keep;
+  }
+};
+
+inline float dot(const Vector4<float>& v1, const Vector4<float>& v2)
+{
+  return simd4f_dot3(v1.simd(), v2.simd());
+}
+
+inline Vector3<float> cross(const Vector4<float>& v1, const Vector4<float>& v2)
+{
+  Vector4<float> c(simd4f_cross3(v1.simd(), v2.simd()));
+  return Vector3<float>(c.x, c.y, c.z);
+}
+
 typedef Vector4<int> Vector4i;
 typedef Vector4<float> Vector4f;
 typedef Vector4<double> Vector4d;
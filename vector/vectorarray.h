@@ -0,0 +1,316 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VECTORARRAY_H_GUARD
+#define VECTORARRAY_H_GUARD
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include "simd.h"
+#include "vector3.h"
+#include "vector4.h"
+#include "matrix4.h"
+
+/* Streams of 3D or 4D float vectors, stored as structure-of-arrays: all the
+   x components in one array, all the y components in the next, and so on.
+   Every array is aligned and padded with zeros to a multiple of 16 floats,
+   so the bulk functions below (transform, dot, cross, normalize, distance)
+   run whole SIMD packs with no remainder loop, one vector per lane: 16 at
+   a time with -mavx512f, 8 with -mavx2, 4 with SSE/NEON (see simdf in
+   simd.h). Convert from and to std::vector<Vector3f> with assign and
+   copyTo, or fill the component arrays directly. */
+
+template<int N> struct VectorArrayElement;
+template<> struct VectorArrayElement<3> { typedef Vector3f Type; };
+template<> struct VectorArrayElement<4> { typedef Vector4f Type; };
+
+template<int N> class VectorArray
+{
+public:
+  typedef typename VectorArrayElement<N>::Type Element;
+
+  /* the component arrays are padded to this many floats */
+  static const size_t PADDING = 16;
+
+private:
+  float* data;
+  size_t count;
+  size_t stride;   /* floats per component array, count rounded up */
+
+public:
+  explicit VectorArray(size_t n = 0) : data(0), count(0), stride(0)
+  {
+    Allocate(n);
+  }
+  explicit VectorArray(const std::vector<Element>& v) : data(0), count(0), stride(0)
+  {
+    assign(v);
+  }
+  VectorArray(const VectorArray<N>& v) : data(0), count(0), stride(0)
+  {
+    *this = v;
+  }
+  ~VectorArray()
+  {
+    simd_free(data);
+  }
+
+  VectorArray<N>& operator=(const VectorArray<N>& v)
+  {
+    if(this != &v){
+      Allocate(v.count);
+      std::memcpy(data, v.data, N * stride * sizeof(float));
+    }
+    return *this;
+  }
+
+  size_t size() const { return count; }
+  /* the length of every component array, padding included */
+  size_t padded() const { return stride; }
+
+  float* component(int c) { return data + c * stride; }
+  const float* component(int c) const { return data + c * stride; }
+  float* x() { return component(0); }
+  float* y() { return component(1); }
+  float* z() { return component(2); }
+  const float* x() const { return component(0); }
+  const float* y() const { return component(1); }
+  const float* z() const { return component(2); }
+  /* Vector4Array only */
+  float* w()
+  {
+    static_assert(N == 4, "w() of a VectorArray without a w component");
+    return component(3);
+  }
+  const float* w() const
+  {
+    static_assert(N == 4, "w() of a VectorArray without a w component");
+    return component(3);
+  }
+
+  Element get(size_t i) const
+  {
+    Element v;
+    float* e = &v.x;
+    for(int c=0; c<N; ++c)
+      e[c] = component(c)[i];
+    return v;
+  }
+  void set(size_t i, const Element& v)
+  {
+    const float* e = &v.x;
+    for(int c=0; c<N; ++c)
+      component(c)[i] = e[c];
+  }
+
+  /* Keeps the first min(n, size()) vectors, the new ones are zero */
+  void resize(size_t n)
+  {
+    if(n == count && data)
+      return;
+    VectorArray<N> old(0);
+    old.Swap(*this);
+    Allocate(n);
+    size_t keep = std::min(n, old.count);
+    for(int c=0; c<N; ++c)
+      std::memcpy(component(c), old.component(c), keep * sizeof(float));
+  }
+
+  void assign(const std::vector<Element>& v)
+  {
+    Allocate(v.size());
+    for(size_t i=0; i<v.size(); ++i)
+      set(i, v[i]);
+  }
+  void copyTo(std::vector<Element>& v) const
+  {
+    v.resize(count);
+    for(size_t i=0; i<count; ++i)
+      v[i] = get(i);
+  }
+
+  void Swap(VectorArray<N>& v)
+  {
+    std::swap(data, v.data);
+    std::swap(count, v.count);
+    std::swap(stride, v.stride);
+  }
+
+private:
+  /* Room for n vectors, all zero */
+  void Allocate(size_t n)
+  {
+    size_t padded = (n + PADDING - 1) / PADDING * PADDING;
+    if(data == 0 || padded != stride){
+      simd_free(data);
+      data = static_cast<float*>(simd_alloc(N * padded * sizeof(float)));
+      if(data == 0)
+	throw std::bad_alloc();
+      stride = padded;
+    }
+    count = n;
+    std::memset(data, 0, N * stride * sizeof(float));
+  }
+};
+
+typedef VectorArray<3> Vector3Array;
+typedef VectorArray<4> Vector4Array;
+
+/* Stores a pack of results at out[i], where the last pack may stick out of
+   out, which is not padded */
+inline void vectorarray_store(std::vector<float>& out, size_t i, simdf v)
+{
+  if(i + SIMDF_WIDTH <= out.size()){
+#if SIMDF_WIDTH == 1
+    out[i] = v;
+#else
+    float* p = &out[i];
+    if((reinterpret_cast<size_t>(p) & (SIMDF_WIDTH * sizeof(float) - 1)) == 0)
+      simdf_store(p, v);
+    else {
+      alignas(64) float tmp[SIMDF_WIDTH];
+      simdf_store(tmp, v);
+      std::memcpy(p, tmp, sizeof(tmp));
+    }
+#endif
+  } else {
+    alignas(64) float tmp[SIMDF_WIDTH];
+    simdf_store(tmp, v);
+    std::copy(tmp, tmp + (out.size() - i), out.begin() + i);
+  }
+}
+
+/* out[i] = mat * in[i], with the same math as operator*(Matrix4, Vector3):
+   the points have an implicit w of 1, and the last row of mat is unused.
+   in and out may be the same array. */
+inline void transform(const Matrix4f& mat, const Vector3Array& in, Vector3Array& out)
+{
+  if(&in != &out)
+    out.resize(in.size());
+  simdf m[12];
+  for(int k=0; k<12; ++k)
+    m[k] = simdf_splat(mat[k]);
+  const float *ix = in.x(), *iy = in.y(), *iz = in.z();
+  float *ox = out.x(), *oy = out.y(), *oz = out.z();
+  for(size_t i=0; i<in.padded(); i+=SIMDF_WIDTH){
+    simdf x = simdf_load(ix + i), y = simdf_load(iy + i), z = simdf_load(iz + i);
+    simdf rx = simdf_madd(z, m[ 2], simdf_madd(y, m[ 1], simdf_madd(x, m[ 0], m[ 3])));
+    simdf ry = simdf_madd(z, m[ 6], simdf_madd(y, m[ 5], simdf_madd(x, m[ 4], m[ 7])));
+    simdf rz = simdf_madd(z, m[10], simdf_madd(y, m[ 9], simdf_madd(x, m[ 8], m[11])));
+    simdf_store(ox + i, rx);
+    simdf_store(oy + i, ry);
+    simdf_store(oz + i, rz);
+  }
+}
+
+/* out[i] = mat * in[i], like operator*(Matrix4, Vector4) */
+inline void transform(const Matrix4f& mat, const Vector4Array& in, Vector4Array& out)
+{
+  if(&in != &out)
+    out.resize(in.size());
+  simdf m[16];
+  for(int k=0; k<16; ++k)
+    m[k] = simdf_splat(mat[k]);
+  const float *ix = in.x(), *iy = in.y(), *iz = in.z(), *iw = in.w();
+  float *ox = out.x(), *oy = out.y(), *oz = out.z(), *ow = out.w();
+  for(size_t i=0; i<in.padded(); i+=SIMDF_WIDTH){
+    simdf x = simdf_load(ix + i), y = simdf_load(iy + i);
+    simdf z = simdf_load(iz + i), w = simdf_load(iw + i);
+    simdf r[4];
+    for(int row=0; row<4; ++row){
+      const simdf* mr = m + row * 4;
+      r[row] = simdf_madd(w, mr[3], simdf_madd(z, mr[2], simdf_madd(y, mr[1], simdf_mul(x, mr[0]))));
+    }
+    simdf_store(ox + i, r[0]);
+    simdf_store(oy + i, r[1]);
+    simdf_store(oz + i, r[2]);
+    simdf_store(ow + i, r[3]);
+  }
+}
+
+/* out[i] = dot(a[i], b[i]), using x, y and z */
+template<int N>
+void dot(const VectorArray<N>& a, const VectorArray<N>& b, std::vector<float>& out)
+{
+  size_t n = std::min(a.size(), b.size());
+  out.resize(n);
+  for(size_t i=0; i<n; i+=SIMDF_WIDTH){
+    simdf d = simdf_mul(simdf_load(a.x() + i), simdf_load(b.x() + i));
+    d = simdf_madd(simdf_load(a.y() + i), simdf_load(b.y() + i), d);
+    d = simdf_madd(simdf_load(a.z() + i), simdf_load(b.z() + i), d);
+    vectorarray_store(out, i, d);
+  }
+}
+
+/* out[i] = |a[i] - b[i]|, using x, y and z */
+template<int N>
+void distance(const VectorArray<N>& a, const VectorArray<N>& b, std::vector<float>& out)
+{
+  size_t n = std::min(a.size(), b.size());
+  out.resize(n);
+  for(size_t i=0; i<n; i+=SIMDF_WIDTH){
+    simdf dx = simdf_sub(simdf_load(a.x() + i), simdf_load(b.x() + i));
+    simdf dy = simdf_sub(simdf_load(a.y() + i), simdf_load(b.y() + i));
+    simdf dz = simdf_sub(simdf_load(a.z() + i), simdf_load(b.z() + i));
+    simdf d = simdf_madd(dz, dz, simdf_madd(dy, dy, simdf_mul(dx, dx)));
+    vectorarray_store(out, i, simdf_sqrt(d));
+  }
+}
+
+/* out[i] = cross(a[i], b[i]). out may be a or b. */
+inline void cross(const Vector3Array& a, const Vector3Array& b, Vector3Array& out)
+{
+  size_t n = std::min(a.size(), b.size());
+  if(&out != &a && &out != &b)
+    out.resize(n);
+  for(size_t i=0; i<out.padded() && i<a.padded() && i<b.padded(); i+=SIMDF_WIDTH){
+    simdf ax = simdf_load(a.x() + i), ay = simdf_load(a.y() + i), az = simdf_load(a.z() + i);
+    simdf bx = simdf_load(b.x() + i), by = simdf_load(b.y() + i), bz = simdf_load(b.z() + i);
+    simdf_store(out.x() + i, simdf_sub(simdf_mul(ay, bz), simdf_mul(az, by)));
+    simdf_store(out.y() + i, simdf_sub(simdf_mul(az, bx), simdf_mul(ax, bz)));
+    simdf_store(out.z() + i, simdf_sub(simdf_mul(ax, by), simdf_mul(ay, bx)));
+  }
+}
+
+/* Scales the xyz part of every vector to unit length. Vectors too short to
+   have a direction become zero, like Vector3::unit. w is left alone. */
+template<int N>
+void normalize(VectorArray<N>& v)
+{
+  simdf one = simdf_splat(1.0f);
+  for(size_t i=0; i<v.padded(); i+=SIMDF_WIDTH){
+    simdf x = simdf_load(v.x() + i), y = simdf_load(v.y() + i), z = simdf_load(v.z() + i);
+    simdf len = simdf_sqrt(simdf_madd(z, z, simdf_madd(y, y, simdf_mul(x, x))));
+    simdf inv = simdf_zero_below(simdf_div(one, len), len, 1e-8f);
+    simdf_store(v.x() + i, simdf_mul(x, inv));
+    simdf_store(v.y() + i, simdf_mul(y, inv));
+    simdf_store(v.z() + i, simdf_mul(z, inv));
+  }
+}
+
+#endif
@@ -0,0 +1,371 @@
+/*
+* Copyright (c) 2010, Mads Andreas Elvheim, mads@mechcore.net
+* All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright
+*       notice, this list of conditions and the following disclaimer in the
+*       documentation and/or other materials provided with the distribution.
+*     * Neither the name of the organization nor the
+*       names of its contributors may be used to endorse or promote products
+*       derived from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED BY Mads Andreas Elvheim ''AS IS'' AND ANY
+* EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Mads Andreas Elvheim BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef VECTOREXPR_H_GUARD
+#define VECTOREXPR_H_GUARD
+#include <cstddef>
+#include <algorithm>
+#include "simd.h"
+#include "vector2.h"
+#include "vector3.h"
+#include "vector4.h"
+#include "vectorarray.h"
+
+/* Expression templates for Vector2, Vector3, Vector4 and VectorArray.
+   vexpr(v) wraps a vector without copying it, and +, -, unary -, and *
+   and / by a scalar (plus the scalar * vector form) on wrapped vectors
+   build a description of the expression instead of computing it:
+
+     Vector3<T> r = evaluate(vexpr(a)*s + vexpr(b)*t - vexpr(c));
+     evaluate(r, vexpr(a)*s + vexpr(b)*t - vexpr(c));   in place
+     r += vexpr(b)*t - vexpr(c);
+
+   evaluate then computes every component of the result in one go, with
+   no vector temporaries in between; for a type like Fraction<int> or
+   Fixed, where every temporary vector costs a few scalar constructions
+   and copies, that is what the plain operators can't avoid. Vector4f
+   expressions run on simd4f. Over VectorArray operands, evaluate makes
+   one pass over the streams with simdf packs, where the operators of
+   vectorarray.h would write an intermediate array per operation; single
+   vectors and scalars in such an expression are the same for every
+   element.
+
+   Everything is component by component, so the result may be one of the
+   operands. An expression refers to the vectors it wraps, so keep it no
+   longer than them, and don't wrap temporaries (vexpr(a + b)) in an
+   expression that outlives the statement. */
+
+template<class V> struct VectorExprTraits;
+template<class T> struct VectorExprTraits<Vector2<T> >
+{
+  typedef T Scalar;
+  static const int SIZE = 2;
+  static const T& get(const Vector2<T>& v, int c) { return c == 0 ? v.x : v.y; }
+};
+template<class T> struct VectorExprTraits<Vector3<T> >
+{
+  typedef T Scalar;
+  static const int SIZE = 3;
+  static const T& get(const Vector3<T>& v, int c) { return c == 0 ? v.x : (c == 1 ? v.y : v.z); }
+};
+template<class T> struct VectorExprTraits<Vector4<T> >
+{
+  typedef T Scalar;
+  static const int SIZE = 4;
+  static const T& get(const Vector4<T>& v, int c)
+  {
+    return c == 0 ? v.x : (c == 1 ? v.y : (c == 2 ? v.z : v.w));
+  }
+};
+
+template<class E> struct VectorExpr
+{
+  const E& self() const { return static_cast<const E&>(*this); }
+};
+
+/* Every node has the component type Scalar and the vector size SIZE (0
+   for a scalar, which fits any size), and some of:
+     operator[](c)  component c of a single vector result
+     simd()         the whole result, for float and SIZE 4
+     pack(c, i)     component c of elements i to i+SIMDF_WIDTH-1, for
+                    float expressions over VectorArrays
+     count()        the number of elements, the smallest VectorArray */
+template<class V> class VectorLeaf : public VectorExpr<VectorLeaf<V> >
+{
+  const V& v;
+
+public:
+  typedef typename VectorExprTraits<V>::Scalar Scalar;
+  static const int SIZE = VectorExprTraits<V>::SIZE;
+
+  explicit VectorLeaf(const V& v) : v(v){}
+  const Scalar& operator[](int c) const { return VectorExprTraits<V>::get(v, c); }
+  simd4f simd() const { return v.simd(); }
+  simdf pack(int c, size_t) const { return simdf_splat(VectorExprTraits<V>::get(v, c)); }
+  size_t count() const { return static_cast<size_t>(-1); }
+};
+
+template<class T> class ScalarLeaf : public VectorExpr<ScalarLeaf<T> >
+{
+  T s;
+
+public:
+  typedef T Scalar;
+  static const int SIZE = 0;
+
+  explicit ScalarLeaf(const T& s) : s(s){}
+  const T& operator[](int) const { return s; }
+  simd4f simd() const { return simd4f_splat(s); }
+  simdf pack(int, size_t) const { return simdf_splat(s); }
+  size_t count() const { return static_cast<size_t>(-1); }
+};
+
+template<int N> class VectorArrayLeaf : public VectorExpr<VectorArrayLeaf<N> >
+{
+  const VectorArray<N>& a;
+
+public:
+  typedef float Scalar;
+  static const int SIZE = N;
+
+  explicit VectorArrayLeaf(const VectorArray<N>& a) : a(a){}
+  simdf pack(int c, size_t i) const { return simdf_load(a.component(c) + i); }
+  size_t count() const { return a.size(); }
+};
+
+struct VectorAddOp
+{
+  template<class T> static T apply(const T& a, const T& b) { return a + b; }
+  static simd4f simd(simd4f a, simd4f b) { return simd4f_add(a, b); }
+  static simdf pack(simdf a, simdf b) { return simdf_add(a, b); }
+};
+struct VectorSubOp
+{
+  template<class T> static T apply(const T& a, const T& b) { return a - b; }
+  static simd4f simd(simd4f a, simd4f b) { return simd4f_sub(a, b); }
+  static simdf pack(simdf a, simdf b) { return simdf_sub(a, b); }
+};
+struct VectorMulOp
+{
+  template<class T> static T apply(const T& a, const T& b) { return a * b; }
+  static simd4f simd(simd4f a, simd4f b) { return simd4f_mul(a, b); }
+  static simdf pack(simdf a, simdf b) { return simdf_mul(a, b); }
+};
+struct VectorDivOp
+{
+  template<class T> static T apply(const T& a, const T& b) { return a / b; }
+  static simd4f simd(simd4f a, simd4f b) { return simd4f_div(a, b); }
+  static simdf pack(simdf a, simdf b) { return simdf_div(a, b); }
+};
+
+template<class Op, class A, class B> class VectorBinary : public VectorExpr<VectorBinary<Op, A, B> >
+{
+  A a;
+  B b;
+
+public:
+  typedef typename A::Scalar Scalar;
+  static const int SIZE = A::SIZE != 0 ? A::SIZE : B::SIZE;
+  static_assert(A::SIZE == 0 || B::SIZE == 0 || A::SIZE == B::SIZE, "vectors of different sizes in one expression");
+
+  VectorBinary(const A& a, const B& b) : a(a), b(b){}
+  Scalar operator[](int c) const { return Op::template apply<Scalar>(a[c], b[c]); }
+  simd4f simd() const { return Op::simd(a.simd(), b.simd()); }
+  simdf pack(int c, size_t i) const { return Op::pack(a.pack(c, i), b.pack(c, i)); }
+  size_t count() const { return std::min(a.count(), b.count()); }
+};
+
+template<class A> class VectorNegate : public VectorExpr<VectorNegate<A> >
+{
+  A a;
+
+public:
+  typedef typename A::Scalar Scalar;
+  static const int SIZE = A::SIZE;
+
+  explicit VectorNegate(const A& a) : a(a){}
+  Scalar operator[](int c) const { return -a[c]; }
+  simd4f simd() const { return simd4f_mul(a.simd(), simd4f_splat(-1.0f)); }
+  simdf pack(int c, size_t i) const { return simdf_mul(a.pack(c, i), simdf_splat(-1.0f)); }
+  size_t count() const { return a.count(); }
+};
+
+template<class T> inline VectorLeaf<Vector2<T> > vexpr(const Vector2<T>& v) { return VectorLeaf<Vector2<T> >(v); }
+template<class T> inline VectorLeaf<Vector3<T> > vexpr(const Vector3<T>& v) { return VectorLeaf<Vector3<T> >(v); }
+template<class T> inline VectorLeaf<Vector4<T> > vexpr(const Vector4<T>& v) { return VectorLeaf<Vector4<T> >(v); }
+template<int N> inline VectorArrayLeaf<N> vexpr(const VectorArray<N>& a) { return VectorArrayLeaf<N>(a); }
+
+template<class A, class B>
+inline VectorBinary<VectorAddOp, A, B> operator+(const VectorExpr<A>& a, const VectorExpr<B>& b)
+{
+  return VectorBinary<VectorAddOp, A, B>(a.self(), b.self());
+}
+template<class A, class B>
+inline VectorBinary<VectorSubOp, A, B> operator-(const VectorExpr<A>& a, const VectorExpr<B>& b)
+{
+  return VectorBinary<VectorSubOp, A, B>(a.self(), b.self());
+}
+template<class A>
+inline VectorBinary<VectorAddOp, A, ScalarLeaf<typename A::Scalar> > operator+(const VectorExpr<A>& a, const typename A::Scalar& s)
+{
+  return VectorBinary<VectorAddOp, A, ScalarLeaf<typename A::Scalar> >(a.self(), ScalarLeaf<typename A::Scalar>(s));
+}
+template<class A>
+inline VectorBinary<VectorSubOp, A, ScalarLeaf<typename A::Scalar> > operator-(const VectorExpr<A>& a, const typename A::Scalar& s)
+{
+  return VectorBinary<VectorSubOp, A, ScalarLeaf<typename A::Scalar> >(a.self(), ScalarLeaf<typename A::Scalar>(s));
+}
+template<class A>
+inline VectorBinary<VectorMulOp, A, ScalarLeaf<typename A::Scalar> > operator*(const VectorExpr<A>& a, const typename A::Scalar& s)
+{
+  return VectorBinary<VectorMulOp, A, ScalarLeaf<typename A::Scalar> >(a.self(), ScalarLeaf<typename A::Scalar>(s));
+}
+template<class A>
+inline VectorBinary<VectorMulOp, ScalarLeaf<typename A::Scalar>, A> operator*(const typename A::Scalar& s, const VectorExpr<A>& a)
+{
+  return VectorBinary<VectorMulOp, ScalarLeaf<typename A::Scalar>, A>(ScalarLeaf<typename A::Scalar>(s), a.self());
+}
+template<class A>
+inline VectorBinary<VectorDivOp, A, ScalarLeaf<typename A::Scalar> > operator/(const VectorExpr<A>& a, const typename A::Scalar& s)
+{
+  return VectorBinary<VectorDivOp, A, ScalarLeaf<typename A::Scalar> >(a.self(), ScalarLeaf<typename A::Scalar>(s));
+}
+template<class A>
+inline VectorNegate<A> operator-(const VectorExpr<A>& a)
+{
+  return VectorNegate<A>(a.self());
+}
+
+/* The vector type an expression evaluates to */
+template<class T, int N> struct VectorExprResult;
+template<class T> struct VectorExprResult<T, 2>
+{
+  typedef Vector2<T> Type;
+  template<class E> static Type make(const E& e) { return Type(e[0], e[1]); }
+};
+template<class T> struct VectorExprResult<T, 3>
+{
+  typedef Vector3<T> Type;
+  template<class E> static Type make(const E& e) { return Type(e[0], e[1], e[2]); }
+};
+template<class T> struct VectorExprResult<T, 4>
+{
+  typedef Vector4<T> Type;
+  template<class E> static Type make(const E& e) { return Type(e[0], e[1], e[2], e[3]); }
+};
+template<> struct VectorExprResult<float, 4>
+{
+  typedef Vector4<float> Type;
+  template<class E> static Type make(const E& e) { return Type(e.simd()); }
+};
+
+template<class E>
+inline typename VectorExprResult<typename E::Scalar, E::SIZE>::Type evaluate(const VectorExpr<E>& e)
+{
+  return VectorExprResult<typename E::Scalar, E::SIZE>::make(e.self());
+}
+
+template<class T, class E>
+inline void evaluate(Vector2<T>& out, const VectorExpr<E>& e)
+{
+  static_assert(E::SIZE == 2, "expression of a different size");
+  out.x = e.self()[0];
+  out.y = e.self()[1];
+}
+
+template<class T, class E>
+inline void evaluate(Vector3<T>& out, const VectorExpr<E>& e)
+{
+  static_assert(E::SIZE == 3, "expression of a different size");
+  /* each component reads only the same component of the operands, so
+     writing them one by one is safe when out is an operand */
+  out.x = e.self()[0];
+  out.y = e.self()[1];
+  out.z = e.self()[2];
+}
+
+template<class T, class E>
+inline void evaluate(Vector4<T>& out, const VectorExpr<E>& e)
+{
+  static_assert(E::SIZE == 4, "expression of a different size");
+  out.x = e.self()[0];
+  out.y = e.self()[1];
+  out.z = e.self()[2];
+  out.w = e.self()[3];
+}
+
+template<class E>
+inline void evaluate(Vector4<float>& out, const VectorExpr<E>& e)
+{
+  static_assert(E::SIZE == 4, "expression of a different size");
+  simd4f_store(&out.x, e.self().simd());
+}
+
+/* out, resized to the smallest of the VectorArrays in e, gets the value
+   of e for every element */
+template<int N, class E>
+inline void evaluate(VectorArray<N>& out, const VectorExpr<E>& e)
+{
+  static_assert(E::SIZE == N, "expression of a different size");
+  size_t count = e.self().count();
+  if(count == static_cast<size_t>(-1))
+    count = 0;
+  if(out.size() != count){
+    /* out may be an operand, which resizing would move */
+    VectorArray<N> result(count);
+    evaluate(result, e);
+    out.Swap(result);
+    return;
+  }
+  for(int c=0; c<N; ++c){
+    float* o = out.component(c);
+    for(size_t i=0; i<out.padded(); i+=SIMDF_WIDTH)
+      simdf_store(o + i, e.self().pack(c, i));
+    /* keep the padding zero */
+    std::fill(o + count, o + out.padded(), 0.0f);
+  }
+}
+
+template<class T, class E>
+inline Vector2<T>& operator+=(Vector2<T>& v, const VectorExpr<E>& e)
+{
+  evaluate(v, vexpr(v) + e.self());
+  return v;
+}
+template<class T, class E>
+inline Vector2<T>& operator-=(Vector2<T>& v, const VectorExpr<E>& e)
+{
+  evaluate(v, vexpr(v) - e.self());
+  return v;
+}
+template<class T, class E>
+inline Vector3<T>& operator+=(Vector3<T>& v, const VectorExpr<E>& e)
+{
+  evaluate(v, vexpr(v) + e.self());
+  return v;
+}
+template<class T, class E>
+inline Vector3<T>& operator-=(Vector3<T>& v, const VectorExpr<E>& e)
+{
+  evaluate(v, vexpr(v) - e.self());
+  return v;
+}
+template<class T, class E>
+inline Vector4<T>& operator+=(Vector4<T>& v, const VectorExpr<E>& e)
+{
+  evaluate(v, vexpr(v) + e.self());
+  return v;
+}
+template<class T, class E>
+inline Vector4<T>& operator-=(Vector4<T>& v, const VectorExpr<E>& e)
+{
+  evaluate(v, vexpr(v) - e.self());
+  return v;
+}
+
+#endif